@@ -1,5 +1,6 @@
 
 #include "game.h"
+#include "map.h"
 
 
 char* prod_name(int prod) {
@@ -140,6 +141,14 @@ int map_range(int x1, int y1, int x2, int y2) {
     return (xd + yd)/2;
 }
 
+int map_index(int x, int y) {
+    if (x >= 0 && y >= 0 && x < *tx_map_axis_x && y < *tx_map_axis_y) {
+        return x/2 + (*tx_map_half_x) * y;
+    } else {
+        return -1;
+    }
+}
+
 MAP* mapsq(int x, int y) {
     if (x >= 0 && y >= 0 && x < *tx_map_axis_x && y < *tx_map_axis_y) {
         int i = x/2 + (*tx_map_half_x) * y;
@@ -157,9 +166,11 @@ int unit_in_tile(MAP* sq) {
 
 int set_move_to(int id, int x, int y) {
     VEH* veh = &tx_vehicles[id];
+    census_move(id, -1);
     veh->waypoint_1_x_coord = x;
     veh->waypoint_1_y_coord = y;
     veh->move_status = STATUS_GOTO;
+    census_move(id, 1);
     veh->status_icon = 'G';
     return SYNC;
 }
@@ -176,7 +187,7 @@ int set_road_to(int id, int x, int y) {
 int set_action(int id, int act, char icon) {
     VEH* veh = &tx_vehicles[id];
     if (act == FORMER_THERMAL_BORE+4)
-        boreholes.insert(mp(veh->x_coord, veh->y_coord));
+        tile_flags.set(PF_BOREHOLE, veh->x_coord, veh->y_coord);
     veh->move_status = act;
     veh->status_icon = icon;
     veh->flags_1 &= 0xFFFEFFFF;
@@ -185,13 +196,21 @@ int set_action(int id, int act, char icon) {
 
 int set_convoy(int id, int res) {
     VEH* veh = &tx_vehicles[id];
-    convoys.insert(mp(veh->x_coord, veh->y_coord));
+    tile_flags.set(PF_CONVOY, veh->x_coord, veh->y_coord);
+    census_move(id, -1);
     veh->type_crawling = res-1;
     veh->move_status = STATUS_CONVOY;
+    census_move(id, 1);
     veh->status_icon = 'C';
     return tx_veh_skip(id);
 }
 
+uint32_t vehicle_key(int id) {
+    VEH* veh = &tx_vehicles[id];
+    return (veh->x_coord | veh->y_coord << 8 | veh->faction_id << 16) * 16777619u
+        ^ (veh->proto_id | (veh->home_base_id + 1) << 16);
+}
+
 int at_target(VEH* veh) {
     return (veh->waypoint_1_x_coord < 0 && veh->waypoint_1_y_coord < 0)
     || (veh->x_coord == veh->waypoint_1_x_coord && veh->y_coord == veh->waypoint_1_y_coord);
@@ -202,19 +221,6 @@ bool water_base(int id) {
     return (sq && sq->altitude < ALTITUDE_MIN_LAND);
 }
 
-bool workable_tile(int x, int y, int fac) {
-    MAP* tile;
-    for (const int* t : offset_20) {
-        int x2 = wrap(x + t[0]);
-        int y2 = y + t[1];
-        tile = mapsq(x2, y2);
-        if (tile && tile->owner == fac && tile->built_items & TERRA_BASE_IN_TILE) {
-            return true;
-        }
-    }
-    return false;
-}
-
 int nearby_items(int x, int y, int item) {
     int n = 0;
     for (const int* t : offset) {
@@ -256,49 +262,182 @@ int coast_tiles(int x, int y) {
     return n;
 }
 
-void TileSearch::init(int x, int y, int tp) {
+int move_cost(MAP* sq1, MAP* sq2, int speed) {
+    const int road = TERRA_ROAD | TERRA_BASE_IN_TILE;
+    int rate = max(1, tx_basic->mov_rate_along_roads);
+    int a = sq1->built_items;
+    int b = sq2->built_items;
+    if (a & b & TERRA_MAGTUBE)
+        return 0;
+    if ((a & road && b & road) || a & b & TERRA_RIVER)
+        return 1;
+    int c = rate;
+    if (b & TERRA_FUNGUS)
+        c = 3*rate;
+    else if (sq2->rocks & TILE_ROCKY)
+        c = 2*rate;
+    return min(c, max(1, speed) * rate);
+}
+
+void TileSearch::init(int x, int y, int tp, int node_limit, int depth_limit) {
     head = 0;
     tail = 0;
-    items = 0;
+    added = 0;
+    nodes = 0;
+    depth = 0;
+    cutoffs = 0;
+    cost = 0;
+    speed = 0;
     type = tp;
-    oldtiles.clear();
+    max_depth = depth_limit;
+    max_nodes = node_limit;
+    if (++gen == 0) {
+        memset(stamp, 0, sizeof(stamp));
+        gen = 1;
+    }
     tile = mapsq(x, y);
     if (tile) {
-        items++;
-        tail = 1;
-        newtiles[0] = mp(x, y);
-        oldtiles.insert(mp(x, y));
+        int i = map_index(x, y);
+        added++;
+        newtiles[tail++] = x | y << 16;
+        stamp[i] = gen;
+        dist[i] = 0;
     }
 }
 
+void TileSearch::init_moves(int x, int y, int tp, int spd, int node_limit) {
+    init(x, y, tp, node_limit);
+    speed = max(1, spd);
+    head = 0;
+    tail = 0;
+    if (tile) {
+        newtiles[tail++] = map_index(x, y);
+    }
+}
+
+int TileSearch::turns() {
+    int moves = speed * max(1, tx_basic->mov_rate_along_roads);
+    return (cost + moves - 1) / moves;
+}
+
+bool search_skip(int type, MAP* sq) {
+    return (type == LAND_ONLY && sq->altitude < ALTITUDE_MIN_LAND)
+        || (type == WATER_ONLY && sq->altitude >= ALTITUDE_MIN_LAND);
+}
+
 int TileSearch::visited() {
-    return oldtiles.size();
+    return added;
+}
+
+bool TileSearch::is_visited(int x, int y) {
+    int i = map_index(x, y);
+    return i >= 0 && stamp[i] == gen && dist[i] != SEARCH_CUT;
+}
+
+int TileSearch::get_depth(int x, int y) {
+    int i = map_index(x, y);
+    return (i >= 0 && stamp[i] == gen && dist[i] != SEARCH_CUT ? dist[i] : -1);
 }
 
 MAP* TileSearch::get_next() {
-    while (items > 0) {
-        bool first = oldtiles.size() == 1;
-        cur_x = newtiles[head].first;
-        cur_y = newtiles[head].second;
-        head = (head + 1) % QSIZE;
-        items--;
+    if (speed > 0) {
+        return get_next_moves();
+    }
+    if (nodes >= max_nodes) {
+        for (; head < tail; head++) {
+            MAP* sq = mapsq(newtiles[head] & 0xffff, newtiles[head] >> 16);
+            cutoffs += (sq && !search_skip(type, sq));
+        }
+        return NULL;
+    }
+    while (head < tail) {
+        bool first = added == 1;
+        cur_x = newtiles[head] & 0xffff;
+        cur_y = newtiles[head] >> 16;
+        head++;
         if (!(tile = mapsq(cur_x, cur_y)))
             continue;
-        bool skip = (type == LAND_ONLY && tile->altitude < ALTITUDE_MIN_LAND) ||
-                    (type == WATER_ONLY && tile->altitude >= ALTITUDE_MIN_LAND);
-        if (!first && skip)
+        depth = dist[map_index(cur_x, cur_y)];
+        if (!first && search_skip(type, tile))
+            continue;
+        for (const int* t : offset) {
+            int x2 = wrap(cur_x + t[0]);
+            int y2 = cur_y + t[1];
+            int i = map_index(x2, y2);
+            if (i >= 0 && stamp[i] != gen) {
+                if (depth >= max_depth) {
+                    cutoffs += !search_skip(type, mapsq(x2, y2));
+                    stamp[i] = gen;
+                    dist[i] = SEARCH_CUT;
+                    continue;
+                }
+                newtiles[tail++] = x2 | y2 << 16;
+                added++;
+                stamp[i] = gen;
+                dist[i] = depth + 1;
+            }
+        }
+        if (!first) {
+            nodes++;
+            return tile;
+        }
+    }
+    return NULL;
+}
+
+/* Dijkstra search, stale heap entries are skipped when popped. */
+MAP* TileSearch::get_next_moves() {
+    auto cmp = [](int a, int b) { return (uint32_t)a > (uint32_t)b; };
+    if (nodes >= max_nodes) {
+        for (; tail > 0; tail--) {
+            cutoffs += (int)(newtiles[tail-1] >> 16) == dist[newtiles[tail-1] & 0xffff];
+        }
+        return NULL;
+    }
+    while (tail > 0) {
+        std::pop_heap(newtiles, newtiles + tail, cmp);
+        uint32_t top = newtiles[--tail];
+        int i = top & 0xffff;
+        bool first = added == 1;
+        if ((int)(top >> 16) > dist[i])
             continue;
+        cur_y = i / *tx_map_half_x;
+        cur_x = (i % *tx_map_half_x) * 2 + (cur_y & 1);
+        cost = dist[i];
+        tile = mapsq(cur_x, cur_y);
         for (const int* t : offset) {
             int x2 = wrap(cur_x + t[0]);
             int y2 = cur_y + t[1];
-            if (items < QSIZE && y2 >= 0 && y2 < *tx_map_axis_y && oldtiles.count(mp(x2, y2)) == 0) {
-                newtiles[tail] = mp(x2, y2);
-                tail = (tail + 1) % QSIZE;
-                items++;
-                oldtiles.insert(mp(x2, y2));
+            int j = map_index(x2, y2);
+            if (j < 0)
+                continue;
+            MAP* sq = mapsq(x2, y2);
+            if (search_skip(type, sq))
+                continue;
+            int c = min(SEARCH_CUT-1, cost + move_cost(tile, sq, speed));
+            if (stamp[j] != gen || c < dist[j]) {
+                if (tail >= HEAPSZ) {
+                    if (stamp[j] != gen) {
+                        cutoffs++;
+                        stamp[j] = gen;
+                        dist[j] = SEARCH_CUT;
+                    }
+                    continue;
+                }
+                if (stamp[j] != gen) {
+                    added++;
+                } else if (dist[j] == SEARCH_CUT) {
+                    added++;
+                    cutoffs--;
+                }
+                stamp[j] = gen;
+                dist[j] = c;
+                newtiles[tail++] = (uint32_t)c << 16 | j;
+                std::push_heap(newtiles, newtiles + tail, cmp);
             }
         }
         if (!first) {
+            nodes++;
             return tile;
         }
     }
@@ -3,7 +3,6 @@
 
 #include "main.h"
 
-#define mp(x, y) std::make_pair(x, y)
 #define min(x, y) std::min(x, y)
 #define max(x, y) std::max(x, y)
 
@@ -36,32 +35,50 @@ int defense_value(UNIT* u);
 int random(int n);
 int wrap(int a);
 int map_range(int x1, int y1, int x2, int y2);
+int map_index(int x, int y);
 MAP* mapsq(int x, int y);
 int unit_in_tile(MAP* sq);
 int set_move_to(int id, int x, int y);
 int set_road_to(int id, int x, int y);
 int set_action(int id, int act, char icon);
 int set_convoy(int id, int res);
+uint32_t vehicle_key(int id);
 int at_target(VEH* veh);
 bool water_base(int id);
-bool workable_tile(int x, int y, int fac);
 int nearby_items(int x, int y, int item);
 int bases_in_range(int x, int y, int range);
 int coast_tiles(int x, int y);
+int move_cost(MAP* sq1, MAP* sq2, int speed);
 
+/* Searches using the same object must not be nested. */
 class TileSearch {
     int type;
     int head;
     int tail;
-    int items;
+    int added;
+    int nodes;
+    int max_depth;
+    int max_nodes;
+    int speed;
+    uint32_t gen;
     MAP* tile;
-    std::pair<int, int> newtiles[QSIZE];
+    int newtiles[MAPTILES];
+    uint32_t stamp[MAPTILES];
+    uint16_t dist[MAPTILES];
     public:
     int cur_x, cur_y;
-    std::set<std::pair <int, int>> oldtiles;
-    void init(int, int, int);
+    int depth;
+    int cost;
+    int cutoffs;
+    void init(int, int, int, int=MAPTILES, int=MAPSZ*2);
+    void init_moves(int, int, int, int, int=MAPTILES);
+    int turns();
     int visited();
+    bool is_visited(int, int);
+    int get_depth(int, int);
     MAP* get_next();
+    private:
+    MAP* get_next_moves();
 };
 
 
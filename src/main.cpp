@@ -2,14 +2,24 @@
 #include "main.h"
 #include "game.h"
 #include "move.h"
+#include "map.h"
 
 FILE* debug_log;
 Config conf;
 int proj_limit[8];
-int diplo_flags[8];
-
-std::set<std::pair <int, int>> convoys;
-std::set<std::pair <int, int>> boreholes;
+Relations relations[8];
+BaseCensus census[BASES];
+TileLayer<int16_t> census_map;
+int census_bases;
+int census_vehs;
+uint32_t census_last;
+ProdCensus prod_census[8];
+int prod_bases[BASES];
+int prod_owners[BASES];
+int prod_count;
+ProtoTable proto_tables[8];
+ProdChoice prod_choices[BASES];
+ProdBatch prod_batches[8];
 
 static int handler(void* user, const char* section, const char* name, const char* value) {
     Config* pconfig = (Config*)user;
@@ -84,14 +94,23 @@ DLL_EXPORT int ThinkerDecide(int mode, int id, int val1, int val2) {
         if (conf.terraform_ai && veh->faction_id <= conf.factions_enabled) {
             int w = tx_units[veh->proto_id].weapon_mode;
             if (w == WMODE_COLONIST) {
+                safety_update();
                 return colony_move(id);
             } else if (w == WMODE_CONVOY) {
+                safety_update();
                 return crawler_move(id);
             } else if (w == WMODE_TERRAFORMER && unit_triad(veh->proto_id) != TRIAD_SEA) {
+                safety_update();
                 return former_move(id);
             }
         }
-        return tx_enemy_move(id);
+        census_move(id, -1);
+        int count = *tx_total_num_vehicles;
+        int value = tx_enemy_move(id);
+        if (count == *tx_total_num_vehicles) {
+            census_move(id, 1);
+        }
+        return value;
     } else if (mode == 5) {
         return turn_upkeep();
     } else if (mode != 1) {
@@ -102,6 +121,7 @@ DLL_EXPORT int ThinkerDecide(int mode, int id, int val1, int val2) {
     int prod = base->queue_production_id[0];
     int owner = base->faction_id;
     int choice = 0;
+    prod_set(id, prod);
 
     if (DEBUG) {
         debuglog("[ turn: %d faction: %d base: %2d x: %2d y: %2d "\
@@ -119,6 +139,9 @@ DLL_EXPORT int ThinkerDecide(int mode, int id, int val1, int val2) {
         debuglog("skipping computer base\n");
         choice = tx_base_prod_choices(id, 0, 0, 0);
     } else {
+        if (prod_batches[owner].turn != *tx_current_turn) {
+            prod_batch(owner);
+        }
         if (prod < 0 && !can_build(id, abs(prod))) {
             debuglog("BUILD CHANGE\n");
             if (base->minerals_accumulated > tx_basic->retool_exemption)
@@ -126,17 +149,25 @@ DLL_EXPORT int ThinkerDecide(int mode, int id, int val1, int val2) {
             else
                 choice = select_prod(id);
         } else if (base->status_flags & BASE_PRODUCTION_DONE) {
-            choice = select_prod(id);
+            choice = prod_cached(id);
         } else {
             debuglog("BUILD OLD\n");
             choice = prod;
         }
         debuglog("choice: %d %s\n", choice, prod_name(choice));
     }
+    prod_set(id, choice);
     fflush(debug_log);
     return choice;
 }
 
+#ifdef BUILD_DEBUG
+/* Called from a debugger while a game is loaded. */
+DLL_EXPORT void ThinkerBench() {
+    stamp_bench();
+}
+#endif
+
 int turn_upkeep() {
     for (int i=1; i<8 && conf.design_units; i++) {
         if (1 << i & *tx_human_players || !tx_factions[i].current_num_bases)
@@ -193,13 +224,8 @@ int turn_upkeep() {
     }
     int minerals[BASES];
     for (int i=1; i<8; i++) {
-        diplo_flags[i] = 0;
-        for (int j=1; j<8; j++) {
-            int* st = &(tx_factions[i].diplo_status[j]);
-            if (i != j && *st & DIPLO_COMMLINK) {
-                diplo_flags[i] |= *st;
-            }
-        }
+        relations[i].turn = 0;
+        faction_relations(i);
         int n = 0;
         for (int j=0; j<*tx_total_num_bases; j++) {
             BASE* b = &tx_bases[j];
@@ -210,7 +236,20 @@ int turn_upkeep() {
         std::sort(minerals, minerals+n);
         proj_limit[i] = max(5, minerals[n*2/3]);
     }
+    change_update();
+    region_upkeep();
+    bonus_update();
+    workable_update();
+    census_update();
+    prod_update();
     move_upkeep();
+    plan_refresh();
+    plan_sites();
+    for (int i=1; i<8 && conf.terraform_ai; i++) {
+        if (~*tx_human_players & (1 << i) && i <= conf.factions_enabled) {
+            plan_crawlers(i);
+        }
+    }
     fflush(debug_log);
 
     return 0;
@@ -277,28 +316,76 @@ int project_score(int fac, int proj) {
         + (f->AI_tech+1) * p->AI_tech + (f->AI_wealth+1) * p->AI_wealth;
 }
 
+void prod_count_base(int base_id, int value) {
+    int prod = prod_bases[base_id];
+    ProdCensus* p = &prod_census[prod_owners[base_id]];
+    if (prod <= -70 || prod == FAC_SUBSPACE_GENERATOR) {
+        p->projects += value;
+    } else if (prod >= 0 && tx_units[prod].weapon_type == WPN_PLANET_BUSTER) {
+        p->nukes += value;
+    }
+}
+
+void prod_update() {
+    for (int i=0; i<8; i++) {
+        prod_census[i].projects = 0;
+        prod_census[i].nukes = 0;
+    }
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        prod_bases[i] = tx_bases[i].queue_production_id[0];
+        prod_owners[i] = tx_bases[i].faction_id;
+        prod_count_base(i, 1);
+    }
+    prod_count = *tx_total_num_bases;
+}
+
+void prod_set(int base_id, int prod) {
+    if (prod_count != *tx_total_num_bases) {
+        prod_update();
+    }
+    prod_count_base(base_id, -1);
+    prod_bases[base_id] = prod;
+    prod_owners[base_id] = tx_bases[base_id].faction_id;
+    prod_count_base(base_id, 1);
+}
+
+int rank_projects(int fac, bool alien) {
+    ProdCensus* p = &prod_census[fac];
+    if (p->rank_turn == *tx_current_turn
+    && (!p->rank_choice || tx_secret_projects[p->rank_choice-70] == -1)) {
+        return p->rank_choice;
+    }
+    int score = INT_MIN;
+    int choice = 0;
+    for (int i=70; i<107; i++) {
+        bool ascent = (i == FAC_ASCENT_TO_TRANSCENDENCE && has_facility(-1, FAC_VOICE_OF_PLANET));
+        if (alien && (i == FAC_ASCENT_TO_TRANSCENDENCE || i == FAC_VOICE_OF_PLANET))
+            continue;
+        if (tx_secret_projects[i-70] == -1 && (ascent || knows_tech(fac, tx_facility[i].preq_tech))) {
+            int sc = project_score(fac, i);
+            choice = (sc > score ? i : choice);
+            score = max(score, sc);
+            debuglog("find_project %d %d %d %s\n", fac, i, sc, (char*)tx_facility[i].name);
+        }
+    }
+    p->rank_turn = *tx_current_turn;
+    p->rank_choice = choice;
+    p->rank_score = score;
+    return choice;
+}
+
 int find_project(int fac) {
     Faction* fact = &tx_factions[fac];
     int bases = fact->current_num_bases;
     int nuke_limit = (fact->planet_busters < fact->AI_fight + 2 ? 1 : 0);
-    int projs = 0;
-    int nukes = 0;
+    int projs = prod_census[fac].projects;
+    int nukes = prod_census[fac].nukes;
 
     bool repeal = *tx_un_charter_repeals > *tx_un_charter_reinstates;
     bool build_nukes = has_weapon(fac, WPN_PLANET_BUSTER) &&
-        (repeal || diplo_flags[fac] & DIPLO_ATROCITY_VICTIM ||
+        (repeal || faction_relations(fac)->flags & DIPLO_ATROCITY_VICTIM ||
         (fact->AI_fight > 0 && fact->AI_power > 0));
 
-    for (int i=0; i<*tx_total_num_bases; i++) {
-        if (tx_bases[i].faction_id == fac) {
-            int prod = tx_bases[i].queue_production_id[0];
-            if (prod <= -70 || prod == FAC_SUBSPACE_GENERATOR) {
-                projs++;
-            } else if (prod >= 0 && tx_units[prod].weapon_type == WPN_PLANET_BUSTER) {
-                nukes++;
-            }
-        }
-    }
     if (build_nukes && nukes < nuke_limit && nukes < bases/8) {
         int best = 0;
         for(int i=0; i<64; i++) {
@@ -318,20 +405,8 @@ int find_project(int fac) {
         if (alien && knows_tech(fac, tx_facility[FAC_SUBSPACE_GENERATOR].preq_tech)) {
             return -FAC_SUBSPACE_GENERATOR;
         }
-        int score = INT_MIN;
-        int choice = 0;
-        for (int i=70; i<107; i++) {
-            bool ascent = (i == FAC_ASCENT_TO_TRANSCENDENCE && has_facility(-1, FAC_VOICE_OF_PLANET));
-            if (alien && (i == FAC_ASCENT_TO_TRANSCENDENCE || i == FAC_VOICE_OF_PLANET))
-                continue;
-            if (tx_secret_projects[i-70] == -1 && (ascent || knows_tech(fac, tx_facility[i].preq_tech))) {
-                int sc = project_score(fac, i);
-                choice = (sc > score ? i : choice);
-                score = max(score, sc);
-                debuglog("find_project %d %d %d %s\n", fac, i, sc, (char*)tx_facility[i].name);
-            }
-        }
-        return (projs > 0 || score > 2 ? -choice : 0);
+        int choice = rank_projects(fac, alien);
+        return (projs > 0 || prod_census[fac].rank_score > 2 ? -choice : 0);
     }
     return 0;
 }
@@ -341,32 +416,38 @@ int count_sea_tiles(int x, int y, int limit) {
     if (!tile || (tile->level >> 5) > LEVEL_SHORE_LINE) {
         return -1;
     }
+    region_refresh();
+    int seen[9];
+    int k = 0;
     int n = 0;
-    TileSearch ts;
-    ts.init(x, y, WATER_ONLY);
-    while (n < limit && (tile = ts.get_next()) != NULL) {
-        n++;
+    if (tile->altitude < ALTITUDE_MIN_LAND) {
+        seen[k++] = region_id(x, y);
+        n = region_at(x, y)->tiles - 1;
+    }
+    for (const int* t : offset) {
+        int x2 = wrap(x + t[0]);
+        int y2 = y + t[1];
+        Region* r = region_at(x2, y2);
+        int id = region_id(x2, y2);
+        if (r && r->water && std::find(seen, seen+k, id) == seen+k) {
+            seen[k++] = id;
+            n += r->tiles;
+        }
     }
+    n = min(limit, n);
     debuglog("count_sea_tiles %d %d %d\n", x, y, n);
     return n;
 }
 
 bool switch_to_sea(int x, int y) {
-    const int limit = 250;
     MAP* tile = mapsq(x, y);
-    if (tile && tile->altitude < ALTITUDE_MIN_LAND) {
+    if (!tile || tile->altitude < ALTITUDE_MIN_LAND) {
         return true;
     }
-    int land = 0;
-    int bases = 0;
-    TileSearch ts;
-    ts.init(x, y, LAND_ONLY);
-    while (ts.visited() < limit && (tile = ts.get_next()) != NULL) {
-        if (ts.cur_y != 0 && ts.cur_y != *tx_map_axis_y-1)
-            land++;
-        if (tile->built_items & TERRA_BASE_IN_TILE)
-            bases++;
-    }
+    region_refresh();
+    Region* r = region_at(x, y);
+    int land = r->tiles - r->polar - (y != 0 && y != *tx_map_axis_y-1 ? 1 : 0);
+    int bases = r->bases - (tile->built_items & TERRA_BASE_IN_TILE ? 1 : 0);
     debuglog("switch_to_sea %d %d %d %d\n", x, y, land, bases);
     return land / max(1, bases) < 14;
 }
@@ -397,8 +478,42 @@ int unit_score(int id, bool def) {
     return v;
 }
 
-bool unit_switch(int id1, int id2, bool def) {
-    return random(16) > 8 + unit_score(id1, def) - unit_score(id2, def);
+/* Lists are dropped on a new turn or when the prototype slots change. */
+ProtoList* proto_list(int fac, int triad, int mode, bool defend) {
+    ProtoTable* t = &proto_tables[fac];
+    UNIT* units = &tx_units[fac*64];
+    int weapon_value = tx_factions[*tx_active_faction].best_weapon_value;
+    int key = (triad*16 + mode)*2 + defend;
+    assert(triad >= 0 && triad < 3 && mode >= 0 && mode < 16);
+    if (t->turn != *tx_current_turn || t->weapon_value != weapon_value
+    || memcmp(t->units, units, sizeof(t->units))) {
+        t->turn = *tx_current_turn;
+        t->weapon_value = weapon_value;
+        memcpy(t->units, units, sizeof(t->units));
+        memset(t->built, 0, sizeof(t->built));
+    }
+    ProtoList* list = &t->lists[key];
+    if (t->built[key/32] & (1 << key%32)) {
+        return list;
+    }
+    list->count = 0;
+    for(int i=0; i<64; i++) {
+        int id = fac*64 + i;
+        UNIT* u = &tx_units[id];
+        if (unit_triad(id) == triad && strlen(u->name) > 0) {
+            if ((mode && u->weapon_mode != mode)
+            || (!mode && tx_weapon[u->weapon_type].offense_value <= 0)
+            || (!mode && defend && u->chassis_type != CHS_INFANTRY)
+            || u->weapon_type == WPN_PLANET_BUSTER)
+                continue;
+            ProtoEntry* e = &list->entries[list->count++];
+            e->slot = i;
+            e->valid = mode || (defend == (offense_value(u) < defense_value(u)));
+            e->score = unit_score(id, defend);
+        }
+    }
+    t->built[key/32] |= (1 << key%32);
+    return list;
 }
 
 int find_proto(int fac, int triad, int mode, bool defend) {
@@ -412,21 +527,15 @@ int find_proto(int fac, int triad, int mode, bool defend) {
         basic = BSC_TRANSPORT_FOIL;
     else if (mode == WMODE_INFOWAR)
         basic = BSC_PROBE_TEAM;
+    ProtoList* list = proto_list(fac, triad, mode, defend);
     int best = basic;
-    for(int i=0; i<64; i++) {
-        int id = fac*64 + i;
-        UNIT* u = &tx_units[id];
-        if (unit_triad(id) == triad && strlen(u->name) > 0) {
-            if ((mode && u->weapon_mode != mode)
-            || (!mode && tx_weapon[u->weapon_type].offense_value <= 0)
-            || (!mode && defend && u->chassis_type != CHS_INFANTRY)
-            || u->weapon_type == WPN_PLANET_BUSTER)
-                continue;
-            bool valid = mode || (defend == (offense_value(u) < defense_value(u)));
-            if (best == basic || (valid && unit_switch(best, id, defend))) {
-                best = id;
-                debuglog("===> %s\n", (char*)&(tx_units[best].name));
-            }
+    int score = 0;
+    for (int i=0; i<list->count; i++) {
+        ProtoEntry* e = &list->entries[i];
+        if (best == basic || (e->valid && random(16) > 8 + score - e->score)) {
+            best = fac*64 + e->slot;
+            score = e->score;
+            debuglog("===> %s\n", (char*)&(tx_units[best].name));
         }
     }
     return best;
@@ -519,62 +628,170 @@ int faction_might(int fac) {
     return max(1, f->mil_strength_1 + f->mil_strength_2 + f->pop_total * 2);
 }
 
-int select_prod(int id) {
-    BASE* base = &tx_bases[id];
-    int fac = base->faction_id;
-    int minerals = base->mineral_surplus;
+Relations* faction_relations(int fac) {
+    Relations* r = &relations[fac];
     Faction* fact = &tx_factions[fac];
-
-    int defenders = 0;
-    int crawlers = 0;
-    int formers = 0;
-    int probes = 0;
-    int pods = 0;
-    int enemymask = 1;
-    int enemyrange = 40;
-    double enemymil = 0;
-
+    if (r->turn == *tx_current_turn && !memcmp(r->status, fact->diplo_status, sizeof(r->status))) {
+        return r;
+    }
+    memcpy(r->status, fact->diplo_status, sizeof(r->status));
+    r->turn = *tx_current_turn;
+    r->flags = 0;
+    r->enemymask = 1;
+    r->enemymil = 0;
     for (int i=1; i<8; i++) {
-        if (i==fac || ~fact->diplo_status[i] & DIPLO_COMMLINK)
+        r->mil[i] = 0;
+        if (i==fac || ~r->status[i] & DIPLO_COMMLINK)
             continue;
-        double mil = (1.0 * faction_might(i)) / faction_might(fac);
-        if (fact->diplo_status[i] & DIPLO_VENDETTA) {
-            enemymask |= (1 << i);
-            enemymil = max(enemymil, 1.0 * mil);
-        } else if (~fact->diplo_status[i] & DIPLO_PACT) {
-            enemymil = max(enemymil, 0.3 * mil);
+        r->flags |= r->status[i];
+        r->mil[i] = (1.0 * faction_might(i)) / faction_might(fac);
+        if (r->status[i] & DIPLO_VENDETTA) {
+            r->enemymask |= (1 << i);
+            r->enemymil = max(r->enemymil, 1.0 * r->mil[i]);
+        } else if (~r->status[i] & DIPLO_PACT) {
+            r->enemymil = max(r->enemymil, 0.3 * r->mil[i]);
         }
     }
-    for (int i=0; i<*tx_total_num_bases; i++) {
-        BASE* b = &tx_bases[i];
-        if ((1 << b->faction_id) & enemymask) {
-            enemyrange = min(enemyrange,
-                map_range(base->x_coord, base->y_coord, b->x_coord, b->y_coord));
+    return r;
+}
+
+void census_unit(BaseCensus* c, int proto, bool convoy, int value) {
+    UNIT* unit = &tx_units[proto];
+    if (unit->weapon_type == WPN_TERRAFORMING_UNIT)
+        c->formers += value;
+    else if (unit->weapon_type == WPN_COLONY_MODULE)
+        c->pods += value;
+    else if (unit->weapon_type == WPN_PROBE_TEAM)
+        c->probes += value;
+    else if (unit->weapon_type == WPN_SUPPLY_TRANSPORT)
+        c->crawlers += (convoy ? 1 : 5) * value;
+}
+
+void census_add(int id, int value) {
+    VEH* veh = &tx_vehicles[id];
+    UNIT* unit = &tx_units[veh->proto_id];
+    int fac = veh->faction_id;
+    int home = veh->home_base_id;
+    if (home >= 0 && home < *tx_total_num_bases && tx_bases[home].faction_id == fac) {
+        census_unit(&census[home], veh->proto_id, veh->move_status == STATUS_CONVOY, value);
+    }
+    if (unit_triad(veh->proto_id) == TRIAD_LAND && unit->weapon_type <= WPN_PSI_ATTACK) {
+        int i = map_index(veh->x_coord, veh->y_coord);
+        if (i >= 0 && census_map[i] > 0 && tx_bases[census_map[i]-1].faction_id == fac)
+            census[census_map[i]-1].defenders += value;
+        for (const int* t : offset) {
+            i = map_index(wrap(veh->x_coord + t[0]), veh->y_coord + t[1]);
+            if (i >= 0 && census_map[i] > 0 && tx_bases[census_map[i]-1].faction_id == fac)
+                census[census_map[i]-1].defenders += value;
         }
     }
+}
 
+void census_update() {
+    census_map.clear();
+    memset(census, 0, sizeof(census));
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        BASE* base = &tx_bases[i];
+        census_map.set(base->x_coord, base->y_coord, i+1);
+    }
     for (int i=0; i<*tx_total_num_vehicles; i++) {
-        VEH* veh = &tx_vehicles[i];
-        UNIT* unit = &tx_units[veh->proto_id];
-        if (veh->faction_id != fac)
+        census_add(i, 1);
+    }
+    census_bases = *tx_total_num_bases;
+    census_vehs = *tx_total_num_vehicles;
+    census_last = (census_vehs > 0 ? vehicle_key(census_vehs-1) : 0);
+}
+
+/* A removed unit compacts the vehicle table, which rebuilds the census. */
+void census_refresh() {
+    if (census_bases != *tx_total_num_bases || census_vehs > *tx_total_num_vehicles
+    || (census_vehs > 0 && census_last != vehicle_key(census_vehs-1))) {
+        census_update();
+        return;
+    }
+    while (census_vehs < *tx_total_num_vehicles) {
+        census_add(census_vehs++, 1);
+    }
+    census_last = (census_vehs > 0 ? vehicle_key(census_vehs-1) : 0);
+}
+
+void census_move(int id, int value) {
+    if (id < census_vehs && census_vehs <= *tx_total_num_vehicles
+    && census_bases == *tx_total_num_bases) {
+        census_add(id, value);
+    }
+}
+
+void census_prod(int id, int prod, int value) {
+    if (prod >= 0) {
+        census_unit(&census[id], prod, false, value);
+        if (unit_triad(prod) == TRIAD_LAND && tx_units[prod].weapon_type <= WPN_PSI_ATTACK)
+            census[id].defenders += value;
+    }
+}
+
+/* Chosen units are counted in the census only until the batch is done. */
+void prod_batch(int fac) {
+    static int ids[BASES];
+    static int prods[BASES];
+    ProdBatch* b = &prod_batches[fac];
+    int n = 0;
+    census_refresh();
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        BASE* base = &tx_bases[i];
+        int prod = base->queue_production_id[0];
+        if (base->faction_id != fac || (prod < 0 && !can_build(i, abs(prod)))
+        || base->minerals_accumulated + base->mineral_surplus < mineral_cost(fac, prod))
             continue;
-        if (veh->home_base_id == id) {
-            if (unit->weapon_type == WPN_TERRAFORMING_UNIT)
-                formers++;
-            else if (unit->weapon_type == WPN_COLONY_MODULE)
-                pods++;
-            else if (unit->weapon_type == WPN_PROBE_TEAM)
-                probes++;
-            else if (unit->weapon_type == WPN_SUPPLY_TRANSPORT)
-                crawlers += (veh->move_status == STATUS_CONVOY ? 1 : 5);
-        }
-        int range = map_range(base->x_coord, base->y_coord, veh->x_coord, veh->y_coord);
-        if (range <= 1) {
-            if (unit_triad(veh->proto_id) == TRIAD_LAND && unit->weapon_type <= WPN_PSI_ATTACK) {
-                defenders++;
-            }
-        }
+        ids[n] = i;
+        prods[n] = (base->status_flags & BASE_PRODUCTION_DONE ? -1 : prod);
+        census_prod(i, prods[n], 1);
+        int choice = select_prod(i);
+        census_prod(i, choice, 1);
+        prod_choices[i] = {*tx_current_turn, base->x_coord, base->y_coord, fac, choice};
+        prod_set(i, choice);
+        n++;
+    }
+    for (int k=0; k<n; k++) {
+        int i = ids[k];
+        census_prod(i, prods[k], -1);
+        census_prod(i, prod_choices[i].choice, -1);
+        prod_set(i, tx_bases[i].queue_production_id[0]);
     }
+    b->turn = *tx_current_turn;
+    b->bases = n;
+    debuglog("prod_batch %d %d %d\n", *tx_current_turn, fac, n);
+}
+
+int prod_cached(int id) {
+    BASE* base = &tx_bases[id];
+    ProdChoice* c = &prod_choices[id];
+    if (c->turn == *tx_current_turn && c->x == base->x_coord && c->y == base->y_coord
+    && c->fac == base->faction_id) {
+        c->turn = 0;
+        debuglog("prod_cached %d %d\n", id, c->choice);
+        return c->choice;
+    }
+    return select_prod(id);
+}
+
+int select_prod(int id) {
+    BASE* base = &tx_bases[id];
+    int fac = base->faction_id;
+    int minerals = base->mineral_surplus;
+    Faction* fact = &tx_factions[fac];
+
+    census_refresh();
+    int defenders = census[id].defenders;
+    int crawlers = census[id].crawlers;
+    int formers = census[id].formers;
+    int probes = census[id].probes;
+    int pods = census[id].pods;
+    Relations* rel = faction_relations(fac);
+    double enemymil = rel->enemymil;
+    enemy_field(fac, rel->enemymask);
+    int enemyrange = min(enemy_travel(fac, base->x_coord, base->y_coord),
+        2 * enemy_range(fac, base->x_coord, base->y_coord));
     int reserve = max(2, base->mineral_intake / 2);
     double base_ratio = 2.0 * fact->current_num_bases / min(80, *tx_map_area_sq_root);
     bool has_formers = has_weapon(fac, WPN_TERRAFORMING_UNIT);
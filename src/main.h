@@ -36,8 +36,8 @@
 #include <windows.h>
 #include <limits.h>
 #include <math.h>
+#include <time.h>
 #include <algorithm>
-#include <set>
 #include "inih/ini.h"
 #include "terranx.h"
 
@@ -47,8 +47,11 @@ static_assert(sizeof(struct VEH) == 52, "");
 static_assert(sizeof(struct MAP) == 44, "");
 
 #define MAPSZ 256
-#define QSIZE 512
+#define MAPTILES (MAPSZ*MAPSZ/2)
+#define HEAPSZ 1024
+#define SEARCH_CUT 0xffff
 #define BASES 512
+#define VEHICLES 2048
 #define COMBAT 0
 #define MAX_SAT 8
 #define SYNC 0
@@ -68,10 +71,11 @@ static_assert(sizeof(struct MAP) == 44, "");
 #define DEF true
 
 DLL_EXPORT int ThinkerDecide(int mode, int id, int val1, int val2);
+#ifdef BUILD_DEBUG
+DLL_EXPORT void ThinkerBench();
+#endif
 
 extern FILE* debug_log;
-extern std::set<std::pair <int, int>> convoys;
-extern std::set<std::pair <int, int>> boreholes;
 
 struct Config {
     int free_formers;
@@ -85,7 +89,75 @@ struct Config {
     int tech_balance;
 };
 
+/* Supply crawlers on convoy count as 1 and other crawlers as 5. */
+struct BaseCensus {
+    int formers;
+    int pods;
+    int probes;
+    int crawlers;
+    int defenders;
+};
+
+struct ProdCensus {
+    int projects;
+    int nukes;
+    int rank_turn;
+    int rank_choice;
+    int rank_score;
+};
+
+/* Military ratios are only counted with a commlink. */
+struct Relations {
+    int turn;
+    int status[8];
+    double mil[8];
+    int flags;
+    int enemymask;
+    double enemymil;
+};
+
+struct ProdChoice {
+    int turn;
+    int x;
+    int y;
+    int fac;
+    int choice;
+};
+
+struct ProdBatch {
+    int turn;
+    int bases;
+};
+
+/* Slot order is kept so that random selection matches a full scan. */
+struct ProtoEntry {
+    uint8_t slot;
+    bool valid;
+    int16_t score;
+};
+
+struct ProtoList {
+    int count;
+    ProtoEntry entries[64];
+};
+
+struct ProtoTable {
+    int turn;
+    int weapon_value;
+    UNIT units[64];
+    uint32_t built[3];
+    ProtoList lists[96];
+};
+
 int turn_upkeep();
+void census_update();
+void census_refresh();
+void census_move(int id, int value);
+void prod_update();
+Relations* faction_relations(int fac);
+void prod_batch(int fac);
+int prod_cached(int id);
+void prod_set(int base_id, int prod);
 int select_prod(int id);
 int find_facility(int id);
 int find_project(int fac);
@@ -0,0 +1,584 @@
+
+#include "map.h"
+
+TileLayer<uint16_t> region_map;
+TileFlags tile_flags;
+uint8_t bonus_bits[MAPTILES/4];
+TileLayer<uint32_t> work_map;
+Region regions[MAPTILES+1];
+int region_count = 0;
+int region_bases = -1;
+int region_queue[MAPTILES];
+
+struct RegionWatch {
+    int x;
+    int y;
+    int turn;
+    bool land;
+};
+
+RegionWatch watched[REGION_WATCH];
+int watch_count = 0;
+
+struct TileState {
+    uint32_t terrain;
+    uint32_t items;
+    uint32_t landmarks;
+};
+
+MapChanges map_changes;
+TileState change_state[MAPTILES];
+uint32_t change_hash[BLOCKS];
+bool change_blocks[BLOCKS];
+int change_turn = 0;
+int change_size = 0;
+
+int map_tiles() {
+    return (*tx_map_half_x) * (*tx_map_axis_y);
+}
+
+void TileStamp::add_row(int y, int c1, int c2, int value) {
+    int* d = &diff[y*(*tx_map_half_x+1)];
+    d[c1] += value;
+    d[c2+1] -= value;
+}
+
+/* Runs longer than the whole row wrap around and add the value again. */
+void TileStamp::add(int x, int y, int range, int value) {
+    int w = *tx_map_half_x;
+    for (int j=-range*2; j<=range*2; j++) {
+        int y2 = y + j;
+        if (y2 < 0 || y2 >= *tx_map_axis_y)
+            continue;
+        int p = y2 & 1;
+        int c1 = (x - range*2 + abs(j) - p) / 2;
+        int c2 = (x + range*2 - abs(j) - p) / 2;
+        if (*tx_map_toggle_flat) {
+            c1 = max(0, c1);
+            c2 = min(w-1, c2);
+            if (c1 <= c2)
+                add_row(y2, c1, c2, value);
+            continue;
+        }
+        int n = c2 - c1 + 1;
+        if (n >= w) {
+            add_row(y2, 0, w-1, value * (n / w));
+            n %= w;
+        }
+        if (n > 0) {
+            c1 = (c1 % w + w) % w;
+            c2 = c1 + n - 1;
+            if (c2 < w) {
+                add_row(y2, c1, c2, value);
+            } else {
+                add_row(y2, c1, w-1, value);
+                add_row(y2, 0, c2-w, value);
+            }
+        }
+    }
+}
+
+bool is_land(MAP* sq) {
+    return sq->altitude >= ALTITUDE_MIN_LAND;
+}
+
+uint32_t tile_terrain(MAP* sq) {
+    return sq->level | sq->altitude << 8 | sq->rocks << 16 | (uint8_t)sq->owner << 24;
+}
+
+int change_flags(TileState* old, MAP* sq) {
+    uint32_t terrain = tile_terrain(sq);
+    int flags = 0;
+    if (((old->terrain >> 8 & 0xff) >= ALTITUDE_MIN_LAND) != is_land(sq))
+        flags |= CHANGE_LAND;
+    if ((old->items ^ sq->built_items) & TERRA_BASE_IN_TILE)
+        flags |= CHANGE_BASE;
+    if (old->items != (uint32_t)sq->built_items)
+        flags |= CHANGE_ITEMS;
+    if ((old->terrain ^ terrain) >> 24)
+        flags |= CHANGE_OWNER;
+    if ((old->terrain ^ terrain) & 0xffffff || old->landmarks != (uint32_t)sq->landmarks)
+        flags |= CHANGE_TERRAIN;
+    return flags;
+}
+
+/* Only the blocks whose hash changed are compared tile by tile. */
+void change_update() {
+    static uint32_t hashes[BLOCKS];
+    MapChanges* m = &map_changes;
+    int w = *tx_map_half_x;
+    int bw = (w + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int bh = (*tx_map_axis_y + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int size = *tx_map_axis_x | *tx_map_axis_y << 16 | (*tx_map_toggle_flat ? 1 << 30 : 0);
+    m->full = (change_size != size || change_turn + 1 != *tx_current_turn);
+    m->flags = 0;
+    m->blocks = 0;
+    m->count = 0;
+    change_size = size;
+    change_turn = *tx_current_turn;
+    memset(hashes, 0, sizeof(uint32_t) * bw * bh);
+    memset(change_blocks, 0, sizeof(change_blocks));
+
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        uint32_t* h = &hashes[(y / BLOCK_SIZE) * bw];
+        MAP* sq = &((*tx_map_ptr)[y*w]);
+        for (int c=0; c < w; c++, sq++) {
+            uint32_t v = h[c / BLOCK_SIZE];
+            v = (v ^ tile_terrain(sq)) * 16777619;
+            v = (v ^ sq->built_items) * 16777619;
+            v = (v ^ sq->landmarks) * 16777619;
+            h[c / BLOCK_SIZE] = v;
+        }
+    }
+    for (int b=0; b < bw * bh; b++) {
+        if (!m->full && hashes[b] == change_hash[b])
+            continue;
+        change_hash[b] = hashes[b];
+        change_blocks[b] = true;
+        m->blocks++;
+        int y2 = min(*tx_map_axis_y, (b / bw + 1) * BLOCK_SIZE);
+        int c2 = min(w, (b % bw + 1) * BLOCK_SIZE);
+        for (int y = (b / bw) * BLOCK_SIZE; y < y2; y++) {
+            for (int c = (b % bw) * BLOCK_SIZE; c < c2; c++) {
+                int i = y*w + c;
+                MAP* sq = &((*tx_map_ptr)[i]);
+                TileState* t = &change_state[i];
+                int flags = (m->full ? 0 : change_flags(t, sq));
+                if (flags) {
+                    TileChange* tc = &m->tiles[m->count++];
+                    tc->x = c*2 + (y&1);
+                    tc->y = y;
+                    tc->flags = flags;
+                    m->flags |= flags;
+                }
+                t->terrain = tile_terrain(sq);
+                t->items = sq->built_items;
+                t->landmarks = sq->landmarks;
+            }
+        }
+    }
+    debuglog("change_update %d %d %d %d\n", *tx_current_turn, m->full, m->blocks, m->count);
+}
+
+bool change_area(int y1, int y2, int c1, int c2) {
+    int w = *tx_map_half_x;
+    int bw = (w + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (map_changes.full)
+        return true;
+    y1 = max(0, y1);
+    y2 = min(*tx_map_axis_y - 1, y2);
+    for (int by = y1 / BLOCK_SIZE; y1 <= y2 && by <= y2 / BLOCK_SIZE; by++) {
+        for (int c = c1; c <= c2; ) {
+            int cc = c;
+            if (cc < 0 || cc >= w) {
+                if (*tx_map_toggle_flat) {
+                    c = (c < 0 ? 0 : c2 + 1);
+                    continue;
+                }
+                cc = (cc % w + w) % w;
+            }
+            if (change_blocks[by*bw + cc / BLOCK_SIZE])
+                return true;
+            c += min(w, (cc / BLOCK_SIZE + 1) * BLOCK_SIZE) - cc;
+        }
+    }
+    return false;
+}
+
+void region_fill(int x, int y, int id) {
+    Region* r = &regions[id];
+    MAP* sq = mapsq(x, y);
+    bool land = is_land(sq);
+    int head = 0;
+    int tail = 0;
+    memset(r, 0, sizeof(Region));
+    r->water = !land;
+    region_map[map_index(x, y)] = id;
+    region_queue[tail++] = x | y << 16;
+
+    while (head < tail) {
+        int x1 = region_queue[head] & 0xffff;
+        int y1 = region_queue[head] >> 16;
+        bool coast = false;
+        head++;
+        sq = mapsq(x1, y1);
+        r->tiles++;
+        if (y1 == 0 || y1 == *tx_map_axis_y-1)
+            r->polar++;
+        if (sq->built_items & TERRA_BASE_IN_TILE)
+            r->bases++;
+        for (const int* t : offset) {
+            int x2 = wrap(x1 + t[0]);
+            int y2 = y1 + t[1];
+            int i = map_index(x2, y2);
+            if (i < 0)
+                continue;
+            sq = mapsq(x2, y2);
+            if (is_land(sq) != land) {
+                coast = true;
+            } else if (region_map[i] != id) {
+                region_map[i] = id;
+                region_queue[tail++] = x2 | y2 << 16;
+            }
+        }
+        if (coast)
+            r->coast++;
+    }
+}
+
+/* Original bridge heuristic. */
+bool bridge_search(int x, int y) {
+    const int range = 4;
+    static TileSearch ts;
+    ts.init(x, y, LAND_ONLY);
+    while (ts.visited() < 120 && ts.get_next() != NULL);
+
+    int n = 0;
+    for (int i=-range*2; i<=range*2; i++) {
+        for (int j=-range*2 + abs(i); j<=range*2 - abs(i); j+=2) {
+            int x2 = wrap(x + i);
+            int y2 = y + j;
+            MAP* sq = mapsq(x2, y2);
+            if (sq && y2 > 0 && y2 < *tx_map_axis_y-1 && is_land(sq)
+            && !ts.is_visited(x2, y2)) {
+                n++;
+            }
+        }
+    }
+    return n > 4;
+}
+
+bool bridge_tile(int x, int y) {
+    const int range = 4;
+    int id = region_map.get(x, y);
+    int other = 0;
+    int land = 0;
+    for (int i=-range*2; i<=range*2; i++) {
+        for (int j=-range*2 + abs(i); j<=range*2 - abs(i); j+=2) {
+            int x2 = wrap(x + i);
+            int y2 = y + j;
+            MAP* sq = mapsq(x2, y2);
+            if (sq && y2 > 0 && y2 < *tx_map_axis_y-1 && is_land(sq)) {
+                land++;
+                other += region_map.get(x2, y2) != id;
+            }
+        }
+    }
+    if (other > 4 || land <= 4)
+        return other > 4;
+    return bridge_search(x, y);
+}
+
+void bridge_update() {
+    int n = 0;
+    int diff = 0;
+    tile_flags.clear(PF_BRIDGE);
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int x=y&1; x < *tx_map_axis_x; x+=2) {
+            if (!is_land(mapsq(x, y)) || coast_tiles(x, y) < 3)
+                continue;
+            bool bridge = bridge_tile(x, y);
+            if (bridge) {
+                tile_flags.set(PF_BRIDGE, x, y);
+                n++;
+            }
+            if (DEBUG && bridge != bridge_search(x, y)) {
+                debuglog("bridge_mismatch %d %d %d\n", x, y, bridge);
+                diff++;
+            }
+        }
+    }
+    debuglog("bridge_update %d %d\n", n, diff);
+}
+
+void watch_update() {
+    int n = 0;
+    for (int i=0; i<watch_count; i++) {
+        if (watched[i].turn + 20 > *tx_current_turn) {
+            watched[i].land = is_land(mapsq(watched[i].x, watched[i].y));
+            watched[n++] = watched[i];
+        }
+    }
+    watch_count = n;
+}
+
+int region_base_key() {
+    int n = *tx_total_num_bases;
+    return (n > 0 ? n | tx_bases[n-1].x_coord << 12 | tx_bases[n-1].y_coord << 20 : 0);
+}
+
+void region_update() {
+    region_map.clear();
+    region_count = 0;
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int x=y&1; x < *tx_map_axis_x; x+=2) {
+            if (!region_map[map_index(x, y)]) {
+                region_fill(x, y, ++region_count);
+            }
+        }
+    }
+    region_bases = region_base_key();
+    watch_update();
+    bridge_update();
+    debuglog("region_update %d %d\n", region_count, watch_count);
+}
+
+void region_upkeep() {
+    if (map_changes.full || map_changes.flags & CHANGE_LAND || !region_count) {
+        region_update();
+        return;
+    }
+    for (int i=0; i<map_changes.count; i++) {
+        TileChange* c = &map_changes.tiles[i];
+        if (c->flags & CHANGE_BASE) {
+            MAP* sq = mapsq(c->x, c->y);
+            region_at(c->x, c->y)->bases += (sq->built_items & TERRA_BASE_IN_TILE ? 1 : -1);
+        }
+    }
+    region_bases = region_base_key();
+    watch_update();
+    debuglog("region_upkeep %d %d\n", region_count, watch_count);
+}
+
+void region_watch(int x, int y) {
+    MAP* sq = mapsq(x, y);
+    if (!sq)
+        return;
+    for (int i=0; i<watch_count; i++) {
+        if (watched[i].x == x && watched[i].y == y) {
+            watched[i].turn = *tx_current_turn;
+            return;
+        }
+    }
+    if (watch_count >= REGION_WATCH) {
+        memmove(watched, watched+1, sizeof(RegionWatch)*(REGION_WATCH-1));
+        watch_count--;
+    }
+    watched[watch_count++] = {x, y, *tx_current_turn, is_land(sq)};
+}
+
+/* Flooding from the tile and its neighbors covers all merged or split parts. */
+void region_refresh() {
+    bool changed = false;
+    if (!region_count) {
+        region_update();
+    }
+    for (int i=0; i<watch_count; i++) {
+        RegionWatch* w = &watched[i];
+        if (is_land(mapsq(w->x, w->y)) == w->land)
+            continue;
+        w->land = !w->land;
+        if (region_count + 9 > MAPTILES) {
+            region_update();
+            return;
+        }
+        changed = true;
+        int x1 = w->x;
+        int y1 = w->y;
+        int first = region_count + 1;
+        region_fill(x1, y1, ++region_count);
+        for (const int* t : offset) {
+            int x2 = wrap(x1 + t[0]);
+            int y2 = y1 + t[1];
+            int j = map_index(x2, y2);
+            if (j >= 0 && region_map[j] < first) {
+                region_fill(x2, y2, ++region_count);
+            }
+        }
+        bonus_invalidate(x1, y1);
+        debuglog("region_refresh %d %d %d\n", x1, y1, region_count);
+    }
+    if (changed) {
+        bridge_update();
+    }
+    if (region_bases != region_base_key()) {
+        for (int i=1; i <= region_count; i++) {
+            regions[i].bases = 0;
+        }
+        for (int i=0; i<*tx_total_num_bases; i++) {
+            Region* r = region_at(tx_bases[i].x_coord, tx_bases[i].y_coord);
+            if (r)
+                r->bases++;
+        }
+        region_bases = region_base_key();
+        debuglog("region_bases %d\n", *tx_total_num_bases);
+    }
+}
+
+int region_id(int x, int y) {
+    int i = map_index(x, y);
+    return (i >= 0 ? region_map[i] : 0);
+}
+
+Region* region_at(int x, int y) {
+    int i = map_index(x, y);
+    return (i >= 0 && region_map[i] ? &regions[region_map[i]] : NULL);
+}
+
+bool can_bridge(int x, int y) {
+    region_refresh();
+    return tile_flags.test(PF_BRIDGE, x, y);
+}
+
+void bonus_set(int i, int bonus) {
+    int shift = (i%4)*2;
+    bonus_bits[i/4] = (bonus_bits[i/4] & ~(3 << shift)) | (bonus & 3) << shift;
+}
+
+void bonus_update() {
+    if (!map_changes.full) {
+        for (int i=0; i<map_changes.count; i++) {
+            bonus_invalidate(map_changes.tiles[i].x, map_changes.tiles[i].y);
+        }
+        return;
+    }
+    tile_flags.clear(PF_BONUS);
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int x=y&1; x < *tx_map_axis_x; x+=2) {
+            bonus_set(map_index(x, y), tx_bonus_at(x, y));
+            tile_flags.set(PF_BONUS, x, y);
+        }
+    }
+}
+
+void bonus_invalidate(int x, int y) {
+    tile_flags.reset(PF_BONUS, x, y);
+}
+
+int bonus_at(int x, int y) {
+    int i = map_index(x, y);
+    if (i < 0) {
+        return RES_NONE;
+    }
+    if (!tile_flags.test(PF_BONUS, x, y)) {
+        bonus_set(i, tx_bonus_at(x, y));
+        tile_flags.set(PF_BONUS, x, y);
+    }
+    int bonus = bonus_bits[i/4] >> (i%4)*2 & 3;
+    if (DEBUG && bonus != tx_bonus_at(x, y)) {
+        debuglog("bonus_mismatch %d %d %d %d\n", x, y, bonus, tx_bonus_at(x, y));
+    }
+    return bonus;
+}
+
+/* Base counts per faction are 4 bits and saturate at 15. */
+void workable_add(int x, int y, int fac) {
+    int shift = fac*4;
+    for (const int* t : offset_20) {
+        int i = map_index(wrap(x + t[0]), y + t[1]);
+        if (i >= 0 && (work_map[i] >> shift & 15) < 15) {
+            work_map[i] += 1 << shift;
+        }
+    }
+}
+
+void workable_update() {
+    work_map.clear();
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        BASE* base = &tx_bases[i];
+        workable_add(base->x_coord, base->y_coord, base->faction_id);
+    }
+}
+
+int workable_bases(int x, int y, int fac) {
+    int i = map_index(x, y);
+    return (i >= 0 ? work_map[i] >> fac*4 & 15 : 0);
+}
+
+int shared_bases(int x, int y) {
+    int i = map_index(x, y);
+    int n = 0;
+    for (uint32_t v = (i >= 0 ? work_map[i] : 0); v; v >>= 4) {
+        n += v & 15;
+    }
+    return n;
+}
+
+bool workable_tile(int x, int y, int fac) {
+    return workable_bases(x, y, fac) > 0;
+}
+
+/* Range ignores terrain, travel only steps over land. */
+struct EnemyField {
+    int mask;
+    uint32_t bases;
+    TileLayer<uint8_t> range;
+    TileLayer<uint8_t> travel;
+};
+
+EnemyField enemy_fields[8];
+uint32_t enemy_bases;
+uint32_t enemy_counts;
+int enemy_turn = -1;
+
+uint32_t base_signature() {
+    uint32_t h = 2166136261u ^ *tx_total_num_bases ^ (*tx_map_axis_x << 16);
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        BASE* base = &tx_bases[i];
+        h = (h ^ (base->x_coord | base->y_coord << 8 | base->faction_id << 16)) * 16777619u;
+    }
+    return h;
+}
+
+uint32_t base_counts() {
+    uint32_t h = *tx_total_num_bases;
+    for (int i=0; i<8; i++) {
+        h = h * 31 + tx_factions[i].current_num_bases;
+    }
+    return h;
+}
+
+void enemy_fill(int mask, TileLayer<uint8_t>& layer, bool land_only) {
+    int head = 0;
+    int tail = 0;
+    memset(&layer[0], ENEMY_RANGE, map_tiles());
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        BASE* base = &tx_bases[i];
+        if ((1 << base->faction_id) & mask && layer.get(base->x_coord, base->y_coord)) {
+            layer.set(base->x_coord, base->y_coord, 0);
+            region_queue[tail++] = base->x_coord | base->y_coord << 16;
+        }
+    }
+    while (head < tail) {
+        int x1 = region_queue[head] & 0xffff;
+        int y1 = region_queue[head] >> 16;
+        int d = layer.get(x1, y1) + 1;
+        head++;
+        if (d >= ENEMY_RANGE)
+            continue;
+        for (const int* t : offset) {
+            int x2 = wrap(x1 + t[0]);
+            int y2 = y1 + t[1];
+            int i = map_index(x2, y2);
+            if (i >= 0 && layer[i] > d && (!land_only || is_land(mapsq(x2, y2)))) {
+                layer[i] = d;
+                region_queue[tail++] = x2 | y2 << 16;
+            }
+        }
+    }
+}
+
+void enemy_field(int fac, int mask) {
+    EnemyField* f = &enemy_fields[fac];
+    uint32_t counts = base_counts();
+    if (enemy_turn != *tx_current_turn || enemy_counts != counts) {
+        enemy_turn = *tx_current_turn;
+        enemy_counts = counts;
+        enemy_bases = base_signature();
+    }
+    if (f->mask != mask || f->bases != enemy_bases) {
+        f->mask = mask;
+        f->bases = enemy_bases;
+        enemy_fill(mask, f->range, false);
+        enemy_fill(mask, f->travel, true);
+        debuglog("enemy_field %d %d %08x\n", fac, mask, enemy_bases);
+    }
+}
+
+int enemy_range(int fac, int x, int y) {
+    return enemy_fields[fac].range.get(x, y);
+}
+
+int enemy_travel(int fac, int x, int y) {
+    return enemy_fields[fac].travel.get(x, y);
+}
@@ -0,0 +1,146 @@
+#ifndef __MAP_H__
+#define __MAP_H__
+
+#include "main.h"
+#include "game.h"
+
+#define REGION_WATCH 32
+#define ENEMY_RANGE 40
+#define BLOCK_SIZE 16
+#define BLOCKS ((MAPSZ/2/BLOCK_SIZE) * (MAPSZ/BLOCK_SIZE))
+
+int map_tiles();
+
+template <class T>
+class TileLayer {
+    T data[MAPTILES];
+    public:
+    void clear() {
+        memset(data, 0, sizeof(T) * map_tiles());
+    }
+    int get(int x, int y) {
+        assert(map_index(x, y) >= 0);
+        return data[x/2 + (*tx_map_half_x) * y];
+    }
+    void set(int x, int y, int value) {
+        assert(map_index(x, y) >= 0);
+        data[x/2 + (*tx_map_half_x) * y] = value;
+    }
+    void add(int x, int y, int value) {
+        assert(map_index(x, y) >= 0);
+        data[x/2 + (*tx_map_half_x) * y] += value;
+    }
+    T& operator[](int i) {
+        return data[i];
+    }
+};
+
+enum TileFlag {
+    PF_CONVOY,
+    PF_BOREHOLE,
+    PF_BRIDGE,
+    PF_BONUS,
+    PF_COUNT,
+};
+
+class TileFlags {
+    uint64_t bits[PF_COUNT][MAPTILES/64];
+    public:
+    void clear(int flag) {
+        memset(bits[flag], 0, sizeof(uint64_t) * ((map_tiles() + 63) / 64));
+    }
+    bool test(int flag, int x, int y) {
+        int i = map_index(x, y);
+        return i >= 0 && (bits[flag][i/64] >> (i%64) & 1);
+    }
+    void set(int flag, int x, int y) {
+        int i = map_index(x, y);
+        if (i >= 0)
+            bits[flag][i/64] |= 1ULL << (i%64);
+    }
+    void reset(int flag, int x, int y) {
+        int i = map_index(x, y);
+        if (i >= 0)
+            bits[flag][i/64] &= ~(1ULL << (i%64));
+    }
+};
+
+/* Stamps are stored as edge deltas per row and summed by apply(). */
+class TileStamp {
+    int diff[MAPSZ*(MAPSZ/2+1)];
+    void add_row(int y, int c1, int c2, int value);
+    public:
+    void add(int x, int y, int range, int value);
+    template <class T>
+    void apply(TileLayer<T>& layer) {
+        int w = *tx_map_half_x;
+        for (int y=0; y < *tx_map_axis_y; y++) {
+            int* d = &diff[y*(w+1)];
+            int sum = 0;
+            for (int c=0; c < w; c++) {
+                sum += d[c];
+                d[c] = 0;
+                layer[y*w + c] += sum;
+            }
+            d[w] = 0;
+        }
+    }
+};
+
+/* Region ids start from 1, zero marks unlabeled tiles. */
+struct Region {
+    int tiles;
+    int polar;
+    int bases;
+    int coast;
+    bool water;
+};
+
+/* When full is set the tile list is empty. */
+enum ChangeFlag {
+    CHANGE_LAND = 1,
+    CHANGE_BASE = 2,
+    CHANGE_ITEMS = 4,
+    CHANGE_OWNER = 8,
+    CHANGE_TERRAIN = 16,
+};
+
+struct TileChange {
+    short x;
+    short y;
+    int flags;
+};
+
+struct MapChanges {
+    bool full;
+    int flags;
+    int blocks;
+    int count;
+    TileChange tiles[MAPTILES];
+};
+
+void change_update();
+bool change_area(int y1, int y2, int c1, int c2);
+void region_update();
+void region_upkeep();
+void region_watch(int x, int y);
+void region_refresh();
+int region_id(int x, int y);
+Region* region_at(int x, int y);
+bool can_bridge(int x, int y);
+void bonus_update();
+void bonus_invalidate(int x, int y);
+int bonus_at(int x, int y);
+void workable_update();
+void workable_add(int x, int y, int fac);
+int workable_bases(int x, int y, int fac);
+int shared_bases(int x, int y);
+bool workable_tile(int x, int y, int fac);
+void enemy_field(int fac, int mask);
+int enemy_range(int fac, int x, int y);
+int enemy_travel(int fac, int x, int y);
+
+extern TileFlags tile_flags;
+extern MapChanges map_changes;
+
+#endif // __MAP_H__
@@ -1,53 +1,332 @@
 
 #include "move.h"
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define PLAN_SSE2
+#include <emmintrin.h>
+#endif
 
-int pm_former[MAPSZ][MAPSZ];
-int pm_safety[MAPSZ][MAPSZ];
+TileLayer<int16_t> pm_former;
+TileLayer<int32_t> pm_safety;
+TileStamp pm_stamp;
+TileLayer<int16_t> site_value;
+TileLayer<int16_t> site_claim;
 
-void adjust_value(int x, int y, int range, int value, int tbl[MAPSZ][MAPSZ]) {
+struct SafetyStamp {
+    short x;
+    short y;
+    int value;
+};
+
+SafetyStamp safety_stamps[VEHICLES];
+int safety_ids[VEHICLES];
+int safety_natives = 0;
+int safety_count = 0;
+uint32_t safety_last = 0;
+
+struct PlanUnit {
+    int id;
+    int edge;
+    int edges;
+    int job;
+};
+
+struct PlanJob {
+    int x;
+    int y;
+    int value;
+    int price;
+    int owner;
+    int res;
+};
+
+struct PlanEdge {
+    int job;
+    int value;
+    int turns;
+};
+
+struct UnitOrder {
+    int turn;
+    short unit;
+    short home;
+    short x;
+    short y;
+    short tx;
+    short ty;
+    int res;
+    int act;
+};
+
+PlanUnit plan_us[VEHICLES];
+PlanJob plan_js[PLAN_JOBS];
+PlanEdge plan_es[PLAN_EDGES];
+TileLayer<int16_t> job_map;
+UnitOrder unit_orders[VEHICLES];
+int former_turns[8];
+
+struct FormerClaim {
+    int turn;
+    int eta;
+    short x;
+    short y;
+    short fac;
+    short act;
+};
+
+TileLayer<int16_t> claim_map;
+FormerClaim former_claims[VEHICLES];
+
+/* Plan entries are the item plus one, the borehole test is always made again. */
+int plan_techs[8];
+TileLayer<uint32_t> plan_items;
+TileLayer<uint32_t> plan_keys;
+TileLayer<uint8_t> plan_map;
+
+/* The forest plane has two padding rows and one padding column on each side. */
+enum PlanBit {
+    PB_BASE = 1 << 0,
+    PB_FUNGUS = 1 << 1,
+    PB_ROAD = 1 << 2,
+    PB_DISALLOWED = 1 << 3,
+    PB_WORKABLE = 1 << 4,
+    PB_ROCKY = 1 << 5,
+    PB_NUTRIENT = 1 << 6,
+    PB_MINERAL = 1 << 7,
+    PB_ENERGY = 1 << 8,
+    PB_JUNGLE = 1 << 9,
+    PB_MINE = 1 << 10,
+    PB_FARM = 1 << 11,
+    PB_CONDENSER = 1 << 12,
+    PB_SOIL_ENR = 1 << 13,
+    PB_SOLAR = 1 << 14,
+    PB_SENSOR = 1 << 15,
+    PB_FOREST = 1 << 16,
+    PB_RAINY = 1 << 17,
+    PB_CHECKER = 1 << 18,
+    PB_GRID = 1 << 19,
+    PB_FOREST_OK = 1 << 20,
+    PB_FARM_OK = 1 << 21,
+    PB_ECO = 1 << 22,
+    PB_SOIL_TECH = 1 << 23,
+};
+
+TileLayer<uint32_t> plan_bits;
+uint8_t plan_forest[MAPSZ+4][MAPSZ/2+2];
+
+/* The first matching rule wins, the last rule always matches. */
+struct PlanRule {
+    uint32_t mask;
+    uint32_t value;
+    uint32_t out;
+};
+
+#define PLAN_ENTRY(item, bore) (((item) + 1) | ((bore) ? PLAN_BORE : 0))
+
+const PlanRule farm_rules[] = {
+    {PB_NUTRIENT, PB_NUTRIENT, PB_FARM_OK},
+    {PB_ENERGY, PB_ENERGY, 0},
+    {PB_MINERAL, PB_MINERAL, 0},
+    {PB_JUNGLE | PB_ECO, PB_JUNGLE, 0},
+    {PB_FOREST_OK, 0, 0},
+    {PB_RAINY, PB_RAINY, PB_FARM_OK},
+    {PB_ECO | PB_CHECKER, PB_ECO | PB_CHECKER, PB_FARM_OK},
+    {0, 0, 0},
+};
+
+const PlanRule item_rules[] = {
+    {PB_BASE, PB_BASE, PLAN_ENTRY(-1, 0)},
+    {PB_FUNGUS, PB_FUNGUS, PLAN_ENTRY(FORMER_REMOVE_FUNGUS, 0)},
+    {PB_ROAD, 0, PLAN_ENTRY(FORMER_ROAD, 0)},
+    {PB_DISALLOWED, PB_DISALLOWED, PLAN_ENTRY(-1, 0)},
+    {PB_WORKABLE, 0, PLAN_ENTRY(-1, 0)},
+    {PB_ROCKY | PB_NUTRIENT, PB_ROCKY | PB_NUTRIENT, PLAN_ENTRY(FORMER_LEVEL_TERRAIN, 1)},
+    {PB_ROCKY | PB_JUNGLE, PB_ROCKY | PB_JUNGLE, PLAN_ENTRY(FORMER_LEVEL_TERRAIN, 1)},
+    {PB_ROCKY | PB_MINE | PB_ECO, PB_ROCKY | PB_ECO, PLAN_ENTRY(FORMER_MINE, 1)},
+    {PB_ROCKY | PB_MINE | PB_MINERAL, PB_ROCKY | PB_MINERAL, PLAN_ENTRY(FORMER_MINE, 1)},
+    {PB_ROCKY | PB_FARM_OK | PB_FARM | PB_ECO, PB_FARM_OK | PB_ECO, PLAN_ENTRY(FORMER_FARM, 1)},
+    {PB_ROCKY | PB_FARM_OK | PB_FARM | PB_NUTRIENT, PB_FARM_OK | PB_NUTRIENT, PLAN_ENTRY(FORMER_FARM, 1)},
+    {PB_ROCKY | PB_FARM_OK | PB_ECO | PB_CONDENSER, PB_FARM_OK | PB_ECO, PLAN_ENTRY(FORMER_CONDENSER, 1)},
+    {PB_ROCKY | PB_FARM_OK | PB_SOIL_TECH | PB_SOIL_ENR, PB_FARM_OK | PB_SOIL_TECH, PLAN_ENTRY(FORMER_SOIL_ENR, 1)},
+    {PB_ROCKY | PB_FARM_OK | PB_ECO | PB_CONDENSER | PB_SOLAR, PB_FARM_OK, PLAN_ENTRY(FORMER_SOLAR, 1)},
+    {PB_ROCKY | PB_FARM_OK, PB_FARM_OK, PLAN_ENTRY(-1, 1)},
+    {PB_ROCKY | PB_FARM | PB_CONDENSER | PB_GRID | PB_SENSOR, PB_GRID, PLAN_ENTRY(FORMER_SENSOR, 1)},
+    {PB_ROCKY | PB_FARM | PB_CONDENSER | PB_FOREST, 0, PLAN_ENTRY(FORMER_FOREST, 1)},
+    {0, 0, PLAN_ENTRY(-1, 1)},
+};
+
+template <class T>
+void adjust_value(int x, int y, int range, int value, TileLayer<T>& tbl) {
     for (int i=-range*2; i<=range*2; i++) {
         for (int j=-range*2 + abs(i); j<=range*2 - abs(i); j+=2) {
             int x2 = wrap(x + i);
             int y2 = y + j;
             if (mapsq(x2, y2)) {
-                tbl[x2][y2] += value;
+                tbl.add(x2, y2, value);
             }
         }
     }
 }
 
+int safety_value(VEH* veh) {
+    if (veh->faction_id != 0)
+        return 0;
+    return (veh->proto_id == BSC_SPORE_LAUNCHER ? -400 : -100);
+}
+
+void safety_stamp(int x, int y, int value) {
+    adjust_value(x, y, 1, value, pm_safety);
+    adjust_value(x, y, 2, value/5, pm_safety);
+}
+
+int safety_check(int i) {
+    SafetyStamp* s = &safety_stamps[i];
+    VEH* veh = &tx_vehicles[i];
+    int v = (i < *tx_total_num_vehicles ? safety_value(veh) : 0);
+    if (s->value == v && (!v || (s->x == veh->x_coord && s->y == veh->y_coord)))
+        return v;
+    if (s->value) {
+        safety_stamp(s->x, s->y, -s->value);
+    }
+    if (v) {
+        safety_stamp(veh->x_coord, veh->y_coord, v);
+        debuglog("safety_update %d %d %d %d %d\n", i, s->x, s->y, veh->x_coord, veh->y_coord);
+    }
+    s->x = veh->x_coord;
+    s->y = veh->y_coord;
+    s->value = v;
+    return v;
+}
+
+void safety_update() {
+    int n = *tx_total_num_vehicles;
+    if (n < safety_count || (safety_count > 0 && safety_last != vehicle_key(safety_count-1))) {
+        int m = max(n, safety_count);
+        safety_natives = 0;
+        for (int i=0; i<m; i++) {
+            if (safety_check(i))
+                safety_ids[safety_natives++] = i;
+        }
+    } else {
+        int k = 0;
+        for (int j=0; j<safety_natives; j++) {
+            if (safety_check(safety_ids[j]))
+                safety_ids[k++] = safety_ids[j];
+        }
+        safety_natives = k;
+        for (int i=safety_count; i<n; i++) {
+            if (safety_check(i))
+                safety_ids[safety_natives++] = i;
+        }
+    }
+    safety_count = n;
+    safety_last = (n > 0 ? vehicle_key(n-1) : 0);
+}
+
 bool other_in_tile(int fac, MAP* sq) {
     int u = unit_in_tile(sq);
     return (u > 0 && u != fac);
 }
 
 void move_upkeep() {
-    convoys.clear();
-    boreholes.clear();
-    memset(pm_former, 0, sizeof(int)*MAPSZ*MAPSZ);
-    memset(pm_safety, 0, sizeof(int)*MAPSZ*MAPSZ);
+    tile_flags.clear(PF_CONVOY);
+    tile_flags.clear(PF_BOREHOLE);
+    pm_former.clear();
+    pm_safety.clear();
+    memset(safety_stamps, 0, sizeof(safety_stamps));
+    safety_natives = 0;
+    if (map_changes.full) {
+        claim_map.clear();
+        memset(former_claims, 0, sizeof(former_claims));
+    }
 
     for (int i=0; i<*tx_total_num_vehicles; i++) {
         VEH* veh = &tx_vehicles[i];
         if (veh->move_status == 18) {
-            boreholes.insert(mp(veh->x_coord, veh->y_coord));
+            tile_flags.set(PF_BOREHOLE, veh->x_coord, veh->y_coord);
         }
-        if (veh->faction_id == 0) {
-            int v = (veh->proto_id == BSC_SPORE_LAUNCHER ? -400 : -100);
-            adjust_value(veh->x_coord, veh->y_coord, 1, v, pm_safety);
-            adjust_value(veh->x_coord, veh->y_coord, 2, v/5, pm_safety);
+        int v = safety_value(veh);
+        if (v) {
+            pm_stamp.add(veh->x_coord, veh->y_coord, 1, v);
+            pm_stamp.add(veh->x_coord, veh->y_coord, 2, v/5);
+            safety_ids[safety_natives++] = i;
         }
+        safety_stamps[i] = {veh->x_coord, veh->y_coord, v};
     }
+    safety_count = *tx_total_num_vehicles;
+    safety_last = (safety_count > 0 ? vehicle_key(safety_count-1) : 0);
+    pm_stamp.apply(pm_safety);
     for (int i=0; i<*tx_total_num_bases; i++) {
         BASE* base = &tx_bases[i];
-        adjust_value(base->x_coord, base->y_coord, 2, base->pop_size, pm_former);
+        pm_stamp.add(base->x_coord, base->y_coord, 2, base->pop_size);
+    }
+    pm_stamp.apply(pm_former);
+}
+
+#ifdef BUILD_DEBUG
+void stamp_bench() {
+    const int reps = 10;
+    static short units[VEHICLES][2];
+    static short bases[BASES][3];
+    static TileLayer<int32_t> loop;
+    static TileLayer<int32_t> stamp;
+    int ticks[3][2];
+    uint32_t seed = 1;
+    if (*tx_map_axis_x <= 0 || *tx_map_axis_y <= 0)
+        return;
+    for (int i=0; i<VEHICLES+BASES; i++) {
+        seed = seed * 1103515245 + 12345;
+        int y = (seed >> 8) % *tx_map_axis_y;
+        int x = ((seed >> 20) % *tx_map_half_x) * 2 + (y & 1);
+        if (i < VEHICLES) {
+            units[i][0] = x;
+            units[i][1] = y;
+        } else {
+            bases[i-VEHICLES][0] = x;
+            bases[i-VEHICLES][1] = y;
+            bases[i-VEHICLES][2] = 1 + seed % 10;
+        }
+    }
+    for (int n=0; n<3; n++) {
+        int r = 2 << n;
+        clock_t start = clock();
+        for (int k=0; k<reps; k++) {
+            loop.clear();
+            for (int i=0; i<VEHICLES; i++) {
+                adjust_value(units[i][0], units[i][1], r, -100, loop);
+            }
+            for (int i=0; i<BASES; i++) {
+                adjust_value(bases[i][0], bases[i][1], r, bases[i][2], loop);
+            }
+        }
+        ticks[n][0] = clock() - start;
+        start = clock();
+        for (int k=0; k<reps; k++) {
+            stamp.clear();
+            for (int i=0; i<VEHICLES; i++) {
+                pm_stamp.add(units[i][0], units[i][1], r, -100);
+            }
+            for (int i=0; i<BASES; i++) {
+                pm_stamp.add(bases[i][0], bases[i][1], r, bases[i][2]);
+            }
+            pm_stamp.apply(stamp);
+        }
+        ticks[n][1] = clock() - start;
+        int diff = 0;
+        for (int y=0; y < *tx_map_axis_y; y++) {
+            for (int x=y&1; x < *tx_map_axis_x; x+=2) {
+                diff += loop.get(x, y) != stamp.get(x, y);
+            }
+        }
+        debuglog("stamp_bench %d %d %d %d %d\n", r, reps, ticks[n][0], ticks[n][1], diff);
     }
+    fflush(debug_log);
 }
+#endif
 
 int want_convoy(int fac, int x, int y, MAP* sq) {
-    if (sq && sq->owner == fac && !convoys.count(mp(x, y))
+    if (sq && sq->owner == fac && !tile_flags.test(PF_CONVOY, x, y)
     && !(sq->built_items & BASE_DISALLOWED)) {
-        int bonus = tx_bonus_at(x, y);
+        int bonus = bonus_at(x, y);
         if (bonus == RES_ENERGY)
             return RES_NONE;
         else if (sq->built_items & TERRA_CONDENSER)
@@ -61,6 +340,12 @@ int want_convoy(int fac, int x, int y, MAP* sq) {
     return RES_NONE;
 }
 
+/* Vehicle ids shift when the table is compacted during the turn. */
+bool order_valid(UnitOrder* o, VEH* veh) {
+    return o->turn == *tx_current_turn && o->unit == veh->proto_id
+        && o->home == veh->home_base_id;
+}
+
 int crawler_move(int id) {
     VEH* veh = &tx_vehicles[id];
     MAP* sq = mapsq(veh->x_coord, veh->y_coord);
@@ -68,6 +353,13 @@ int crawler_move(int id) {
         return tx_veh_skip(id);
     if (!at_target(veh))
         return SYNC;
+    UnitOrder* o = &unit_orders[id];
+    if (order_valid(o, veh)) {
+        if (o->tx == veh->x_coord && o->ty == veh->y_coord)
+            return set_convoy(id, o->res);
+        if (o->x == veh->x_coord && o->y == veh->y_coord && o->tx >= 0)
+            return set_move_to(id, o->tx, o->ty);
+    }
     BASE* base = &tx_bases[veh->home_base_id];
     int res = want_convoy(veh->faction_id, veh->x_coord, veh->y_coord, sq);
     bool prefer_min = base->nutrient_surplus > 4 + base->pop_size/2;
@@ -78,13 +370,12 @@ int crawler_move(int id) {
     if (res && v1 > 1) {
         return set_convoy(id, res);
     }
-    int i = 0;
     int cx = -1;
     int cy = -1;
-    TileSearch ts;
-    ts.init(veh->x_coord, veh->y_coord, LAND_ONLY);
+    static TileSearch ts;
+    ts.init_moves(veh->x_coord, veh->y_coord, LAND_ONLY, unit_speed(veh->proto_id), 40);
 
-    while (i++ < 40 && (sq = ts.get_next()) != NULL) {
+    while ((sq = ts.get_next()) != NULL) {
         int other = unit_in_tile(sq);
         if (other > 0 && other != veh->faction_id) {
             debuglog("convoy_skip %d %d %d %d %d %d\n", veh->x_coord, veh->y_coord,
@@ -92,7 +383,7 @@ int crawler_move(int id) {
             continue;
         }
         res = want_convoy(veh->faction_id, ts.cur_x, ts.cur_y, sq);
-        if (res && pm_safety[ts.cur_x][ts.cur_y] >= PM_SAFE) {
+        if (res && pm_safety.get(ts.cur_x, ts.cur_y) >= PM_SAFE) {
             int v2 = (sq->built_items & TERRA_FOREST ? 1 : 2);
             if (prefer_min && res == RES_MINERAL && v2 > 1) {
                 return set_move_to(id, ts.cur_x, ts.cur_y);
@@ -106,6 +397,7 @@ int crawler_move(int id) {
             }
         }
     }
+    debuglog("crawler_search %d %d %d %d\n", veh->x_coord, veh->y_coord, id, ts.cutoffs);
     if (cx >= 0)
         return set_move_to(id, cx, cy);
     if (v1 > 0)
@@ -122,44 +414,120 @@ int want_base(MAP* sq, int triad) {
     return false;
 }
 
+bool site_tile(int y, MAP* sq) {
+    return !(sq->rocks & TILE_ROCKY)
+        && !(sq->built_items & (BASE_DISALLOWED | TERRA_CONDENSER))
+        && y > 1 && y < *tx_map_axis_y-2;
+}
+
+void site_update(int x, int y) {
+    adjust_value(x, y, 2, SITE_BLOCKED, site_value);
+    adjust_value(x, y, 3, 2, site_value);
+}
+
+void plan_sites() {
+    site_value.clear();
+    site_claim.clear();
+    for (int i=0; i<*tx_total_num_bases; i++) {
+        BASE* base = &tx_bases[i];
+        pm_stamp.add(base->x_coord, base->y_coord, 2, SITE_BLOCKED);
+        pm_stamp.add(base->x_coord, base->y_coord, 3, 2);
+    }
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int x=y&1; x < *tx_map_axis_x; x+=2) {
+            if (bonus_at(x, y) != RES_NONE)
+                pm_stamp.add(x, y, 1, 3);
+        }
+    }
+    pm_stamp.apply(site_value);
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int x=y&1; x < *tx_map_axis_x; x+=2) {
+            MAP* sq = mapsq(x, y);
+            if (!site_tile(y, sq)) {
+                site_value.set(x, y, SITE_BLOCKED);
+            } else if (sq->altitude >= ALTITUDE_MIN_LAND) {
+                site_value.add(x, y, (coast_tiles(x, y) > 0 ? 2 : 0)
+                    + (sq->built_items & TERRA_RIVER ? 1 : 0));
+            }
+        }
+    }
+    for (int i=0; i<*tx_total_num_vehicles; i++) {
+        VEH* veh = &tx_vehicles[i];
+        if (tx_units[veh->proto_id].weapon_mode == WMODE_COLONIST
+        && veh->move_status == STATUS_GOTO && !at_target(veh)
+        && mapsq(veh->waypoint_1_x_coord, veh->waypoint_1_y_coord)) {
+            site_claim.set(veh->waypoint_1_x_coord, veh->waypoint_1_y_coord, i+1);
+        }
+    }
+}
+
+int site_owner(int x, int y) {
+    int v = site_claim.get(x, y) - 1;
+    if (v < 0 || v >= *tx_total_num_vehicles)
+        return -1;
+    VEH* veh = &tx_vehicles[v];
+    if (tx_units[veh->proto_id].weapon_mode != WMODE_COLONIST
+    || veh->move_status != STATUS_GOTO || veh->waypoint_1_x_coord != x
+    || veh->waypoint_1_y_coord != y)
+        return -1;
+    return v;
+}
+
 int colony_move(int id) {
     VEH* veh = &tx_vehicles[id];
     MAP* sq = mapsq(veh->x_coord, veh->y_coord);
+    int triad = unit_triad(veh->proto_id);
 
-    if (sq && !(sq->rocks & TILE_ROCKY)
-    && !(sq->built_items & (BASE_DISALLOWED | TERRA_CONDENSER))
-    && veh->y_coord > 1 && veh->y_coord < *tx_map_axis_y-2
+    if (sq && site_tile(veh->y_coord, sq)
     && !bases_in_range(veh->x_coord, veh->y_coord, 2)
-    && want_base(sq, unit_triad(veh->proto_id))) {
+    && want_base(sq, triad)) {
+        int x = veh->x_coord;
+        int y = veh->y_coord;
+        int fac = veh->faction_id;
         tx_action_build(id, 0);
+        site_update(x, y);
+        workable_add(x, y, fac);
         return SYNC;
     }
-    return tx_enemy_move(id);
-}
-
-bool can_bridge(int x, int y) {
-    if (coast_tiles(x, y) < 3)
-        return false;
-    const int range = 4;
-    MAP* sq;
-    TileSearch ts;
-    ts.init(x, y, LAND_ONLY);
-    while (ts.visited() < 120 && ts.get_next() != NULL);
+    if (!sq)
+        return tx_enemy_move(id);
+    if (veh->move_status == STATUS_GOTO && !at_target(veh)
+    && mapsq(veh->waypoint_1_x_coord, veh->waypoint_1_y_coord)
+    && site_value.get(veh->waypoint_1_x_coord, veh->waypoint_1_y_coord) >= 0) {
+        int v = site_owner(veh->waypoint_1_x_coord, veh->waypoint_1_y_coord);
+        if (v < 0 || v == id) {
+            site_claim.set(veh->waypoint_1_x_coord, veh->waypoint_1_y_coord, id+1);
+            return SYNC;
+        }
+    }
+    int fac = veh->faction_id;
+    int tscore = INT_MIN;
+    int tx = -1;
+    int ty = -1;
+    static TileSearch ts;
+    ts.init_moves(veh->x_coord, veh->y_coord, (triad == TRIAD_SEA ? WATER_ONLY : LAND_ONLY),
+        unit_speed(veh->proto_id), 80);
 
-    int n = 0;
-    for (int i=-range*2; i<=range*2; i++) {
-        for (int j=-range*2 + abs(i); j<=range*2 - abs(i); j+=2) {
-            int x2 = wrap(x + i);
-            int y2 = y + j;
-            sq = mapsq(x2, y2);
-            if (sq && y2 > 0 && y2 < *tx_map_axis_y-1 && sq->altitude >= ALTITUDE_MIN_LAND
-            && ts.oldtiles.count(mp(x2, y2)) == 0) {
-                n++;
-            }
+    while ((sq = ts.get_next()) != NULL) {
+        int value = site_value.get(ts.cur_x, ts.cur_y);
+        if (value < 0 || !want_base(sq, triad) || (sq->owner > 0 && sq->owner != fac)
+        || site_owner(ts.cur_x, ts.cur_y) >= 0 || pm_safety.get(ts.cur_x, ts.cur_y) < PM_SAFE
+        || other_in_tile(fac, sq))
+            continue;
+        int score = value - 2*ts.turns();
+        if (score > tscore) {
+            tx = ts.cur_x;
+            ty = ts.cur_y;
+            tscore = score;
         }
     }
-    debuglog("bridge %d %d %d %d\n", x, y, ts.visited(), n);
-    return n > 4;
+    if (tx >= 0) {
+        site_claim.set(tx, ty, id+1);
+        debuglog("colony_move %d %d -> %d %d %d %d %d %d\n",
+            veh->x_coord, veh->y_coord, tx, ty, fac, id, tscore, ts.cutoffs);
+        return set_move_to(id, tx, ty);
+    }
+    return tx_enemy_move(id);
 }
 
 bool can_borehole(int x, int y, int bonus) {
@@ -168,14 +536,14 @@ bool can_borehole(int x, int y, int bonus) {
         return false;
     if (bonus == RES_NONE && sq->rocks & TILE_ROLLING)
         return false;
-    if (pm_former[x][y] < 4 || !workable_tile(x, y, sq->owner))
+    if (pm_former.get(x, y) < 4 || !workable_tile(x, y, sq->owner))
         return false;
     int level = sq->level >> 5;
     for (const int* t : offset) {
         int x2 = wrap(x + t[0]);
         int y2 = y + t[1];
         sq = mapsq(x2, y2);
-        if (!sq || sq->built_items & TERRA_THERMAL_BORE || boreholes.count(mp(x2, y2)))
+        if (!sq || sq->built_items & TERRA_THERMAL_BORE || tile_flags.test(PF_BOREHOLE, x2, y2))
             return false;
         int level2 = sq->level >> 5;
         if (level2 < level && level2 > LEVEL_OCEAN_SHELF)
@@ -198,31 +566,23 @@ bool can_farm(int x, int y, int bonus, bool has_eco, MAP* sq) {
     return (has_eco && !(x % 2) && !(y % 2) && !(abs(x-y) % 4));
 }
 
-int select_item(int x, int y, int fac, MAP* sq) {
+int plan_base_item(int x, int y, int fac, MAP* sq, bool* bore) {
     int items = sq->built_items;
-    int bonus = tx_bonus_at(x, y);
+    int bonus = bonus_at(x, y);
     bool rocky_sq = sq->rocks & TILE_ROCKY;
     bool has_eco = has_terra(fac, FORMER_CONDENSER);
 
+    *bore = false;
     if (items & TERRA_BASE_IN_TILE)
         return -1;
     if (items & TERRA_FUNGUS)
         return FORMER_REMOVE_FUNGUS;
     if (~items & TERRA_ROAD)
         return FORMER_ROAD;
-    if (has_terra(fac, FORMER_RAISE_LAND) && can_bridge(x, y)) {
-        int cost = tx_terraform_cost(x, y, fac);
-        if (cost < tx_factions[fac].energy_credits/10) {
-            debuglog("bridge_cost %d %d %d %d\n", x, y, fac, cost);
-            tx_factions[fac].energy_credits -= cost;
-            return FORMER_RAISE_LAND;
-        }
-    }
     if (items & BASE_DISALLOWED || !workable_tile(x, y, fac))
         return -1;
 
-    if (has_terra(fac, FORMER_THERMAL_BORE) && can_borehole(x, y, bonus))
-        return FORMER_THERMAL_BORE;
+    *bore = true;
     if (rocky_sq && (bonus == RES_NUTRIENT || sq->landmarks & LM_JUNGLE))
         return FORMER_LEVEL_TERRAIN;
     if (rocky_sq && ~items & TERRA_MINE && (has_eco || bonus == RES_MINERAL))
@@ -245,7 +605,241 @@ int select_item(int x, int y, int fac, MAP* sq) {
     return -1;
 }
 
-int tile_score(int x1, int y1, int x2, int y2, MAP* sq) {
+void plan_terra(int fac) {
+    plan_techs[fac] = (has_terra(fac, FORMER_CONDENSER) ? PB_ECO : 0)
+        | (has_terra(fac, FORMER_SOIL_ENR) ? PB_SOIL_TECH : 0);
+}
+
+uint32_t plan_key(int fac, MAP* sq, int bonus, bool workable) {
+    return PLAN_VALID | plan_techs[fac] | fac | sq->rocks << 3 | sq->level << 11
+        | bonus << 19 | workable << 21 | (sq->landmarks & LM_JUNGLE ? 1 : 0) << 24;
+}
+
+void plan_changed(int x, int y) {
+    for (int k=0; k < 9; k++) {
+        int x2 = (k < 8 ? wrap(x + offset[k][0]) : x);
+        int y2 = (k < 8 ? y + offset[k][1] : y);
+        int i = map_index(x2, y2);
+        MAP* sq = mapsq(x2, y2);
+        if (i < 0 || !sq || plan_items[i] == (uint32_t)sq->built_items)
+            continue;
+        for (const int* t : offset) {
+            int j = map_index(wrap(x2 + t[0]), y2 + t[1]);
+            if (j >= 0)
+                plan_keys[j] = 0;
+        }
+        plan_keys[i] = 0;
+        plan_items[i] = sq->built_items;
+    }
+}
+
+int plan_item(int x, int y, int fac, MAP* sq) {
+    bool bore;
+    int i = map_index(x, y);
+    int entry;
+    if (sq->owner == fac && i >= 0) {
+        uint32_t key = plan_key(fac, sq, bonus_at(x, y), workable_tile(x, y, fac));
+        plan_changed(x, y);
+        if (plan_keys[i] != key) {
+            int item = plan_base_item(x, y, fac, sq, &bore);
+            plan_map[i] = (item + 1) | (bore ? PLAN_BORE : 0);
+            plan_keys[i] = key;
+        }
+        entry = plan_map[i];
+    } else {
+        int item = plan_base_item(x, y, fac, sq, &bore);
+        entry = (item + 1) | (bore ? PLAN_BORE : 0);
+    }
+    if (entry & PLAN_BORE && has_terra(fac, FORMER_THERMAL_BORE)
+    && can_borehole(x, y, bonus_at(x, y)))
+        return FORMER_THERMAL_BORE;
+    return (entry & (PLAN_BORE - 1)) - 1;
+}
+
+#ifdef PLAN_SSE2
+int plan_simd = -1;
+
+/* plan_rules checks the CPU before calling this. */
+__attribute__((target("sse2")))
+int plan_rules_sse2(const PlanRule* rules, int n, uint32_t* feats, uint32_t* out, int count) {
+    int lanes = count & ~3;
+    for (int c=0; c < lanes; c++) {
+        out[c] = rules[n-1].out;
+    }
+    for (int j=n-2; j >= 0; j--) {
+        __m128i m = _mm_set1_epi32(rules[j].mask);
+        __m128i v = _mm_set1_epi32(rules[j].value);
+        __m128i r = _mm_set1_epi32(rules[j].out);
+        for (int c=0; c < lanes; c += 4) {
+            __m128i f = _mm_loadu_si128((__m128i*)&feats[c]);
+            __m128i o = _mm_loadu_si128((__m128i*)&out[c]);
+            __m128i t = _mm_cmpeq_epi32(_mm_and_si128(f, m), v);
+            o = _mm_or_si128(_mm_and_si128(t, r), _mm_andnot_si128(t, o));
+            _mm_storeu_si128((__m128i*)&out[c], o);
+        }
+    }
+    return lanes;
+}
+#endif
+
+/* Rules are applied from the last one so that earlier rules win. */
+void plan_rules(const PlanRule* rules, int n, uint32_t* feats, uint32_t* out, int count) {
+    int c = 0;
+#ifdef PLAN_SSE2
+    if (plan_simd < 0) {
+        __builtin_cpu_init();
+        plan_simd = __builtin_cpu_supports("sse2");
+        debuglog("plan_simd %d\n", plan_simd);
+    }
+    if (plan_simd) {
+        c = plan_rules_sse2(rules, n, feats, out, count);
+    }
+#endif
+    for (; c < count; c++) {
+        int j = 0;
+        while (j < n-1 && (feats[c] & rules[j].mask) != rules[j].value) {
+            j++;
+        }
+        out[c] = rules[j].out;
+    }
+}
+
+int plan_span(int y, int c1, int c2) {
+    static uint32_t row[MAPSZ/2];
+    int w = *tx_map_half_x;
+    int n = 0;
+    uint32_t* feats = &plan_bits[y*w + c1];
+    uint8_t* f0 = plan_forest[y] + c1;
+    uint8_t* f1 = plan_forest[y + 1] + c1 + (y&1);
+    uint8_t* f2 = plan_forest[y + 2] + c1;
+    uint8_t* f3 = plan_forest[y + 3] + c1 + (y&1);
+    uint8_t* f4 = plan_forest[y + 4] + c1;
+    int len = c2 - c1;
+    for (int c=0; c < len; c++) {
+        int k = f2[c] + f2[c+2] + f0[c+1] + f4[c+1] + f1[c] + f1[c+1] + f3[c] + f3[c+1];
+        feats[c] |= (k >= (f2[c+1] ? 3 : 1) ? PB_FOREST_OK : 0);
+    }
+    plan_rules(farm_rules, sizeof(farm_rules)/sizeof(PlanRule), feats, row, len);
+    for (int c=0; c < len; c++) {
+        feats[c] |= row[c];
+    }
+    plan_rules(item_rules, sizeof(item_rules)/sizeof(PlanRule), feats, row, len);
+    for (int c=0; c < len; c++) {
+        int i = y*w + c1 + c;
+        plan_map[i] = row[c];
+        n += (plan_keys[i] != 0);
+        if (DEBUG && plan_keys[i]) {
+            int x = (c1 + c)*2 + (y&1);
+            MAP* sq = mapsq(x, y);
+            bool bore;
+            int item = plan_base_item(x, y, sq->owner, sq, &bore);
+            if (row[c] != (uint32_t)PLAN_ENTRY(item, bore)) {
+                debuglog("plan_mismatch %d %d %d %d %d\n", x, y, sq->owner, item, row[c]);
+            }
+        }
+    }
+    return n;
+}
+
+/* Only the blocks within three tiles of a changed block are planned again. */
+void plan_refresh() {
+    static bool blocks[MAPSZ][MAPSZ/2/BLOCK_SIZE];
+    int techs[8];
+    int w = *tx_map_half_x;
+    int bw = (w + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int n = 0;
+    memcpy(techs, plan_techs, sizeof(techs));
+    for (int i=1; i<8; i++) {
+        plan_terra(i);
+    }
+    bool full = map_changes.full || memcmp(techs, plan_techs, sizeof(techs));
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int b=0; b < bw; b++) {
+            blocks[y][b] = full || change_area(y - 3, y + 3,
+                b*BLOCK_SIZE - 2, (b + 1)*BLOCK_SIZE + 1);
+        }
+    }
+    memset(plan_forest[0], 0, sizeof(plan_forest[0]) * 2);
+    memset(plan_forest[*tx_map_axis_y + 2], 0, sizeof(plan_forest[0]) * 2);
+
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        uint8_t* forest = plan_forest[y + 2];
+        for (int c=0; c < w; c++) {
+            if (!blocks[y][c / BLOCK_SIZE]) {
+                c += BLOCK_SIZE - 1;
+                continue;
+            }
+            int x = c*2 + (y&1);
+            int i = y*w + c;
+            MAP* sq = &((*tx_map_ptr)[i]);
+            int items = sq->built_items;
+            int fac = sq->owner;
+            plan_items[i] = items;
+            forest[c + 1] = (items & TERRA_FOREST ? 1 : 0);
+            if (fac <= 0) {
+                plan_bits[i] = 0;
+                plan_keys[i] = 0;
+                continue;
+            }
+            int bonus = bonus_at(x, y);
+            bool workable = workable_tile(x, y, fac);
+            plan_bits[i] = plan_techs[fac]
+                | (items & TERRA_BASE_IN_TILE ? PB_BASE : 0)
+                | (items & TERRA_FUNGUS ? PB_FUNGUS : 0)
+                | (items & TERRA_ROAD ? PB_ROAD : 0)
+                | (items & BASE_DISALLOWED ? PB_DISALLOWED : 0)
+                | (workable ? PB_WORKABLE : 0)
+                | (sq->rocks & TILE_ROCKY ? PB_ROCKY : 0)
+                | (bonus == RES_NUTRIENT ? PB_NUTRIENT : 0)
+                | (bonus == RES_MINERAL ? PB_MINERAL : 0)
+                | (bonus == RES_ENERGY ? PB_ENERGY : 0)
+                | (sq->landmarks & LM_JUNGLE ? PB_JUNGLE : 0)
+                | (items & TERRA_MINE ? PB_MINE : 0)
+                | (items & TERRA_FARM ? PB_FARM : 0)
+                | (items & TERRA_CONDENSER ? PB_CONDENSER : 0)
+                | (items & TERRA_SOIL_ENR ? PB_SOIL_ENR : 0)
+                | (items & TERRA_SOLAR ? PB_SOLAR : 0)
+                | (items & TERRA_SENSOR ? PB_SENSOR : 0)
+                | (items & TERRA_FOREST ? PB_FOREST : 0)
+                | (sq->level & TILE_RAINY && sq->rocks & TILE_ROLLING ? PB_RAINY : 0)
+                | (!(x % 2) && !(y % 2) && !(abs(x-y) % 4) ? PB_CHECKER : 0)
+                | (!(x % 3) && !(y % 3) ? PB_GRID : 0);
+            plan_keys[i] = plan_key(fac, sq, bonus, workable);
+        }
+        forest[0] = (*tx_map_toggle_flat ? 0 : forest[w]);
+        forest[w + 1] = (*tx_map_toggle_flat ? 0 : forest[1]);
+    }
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int b=0; b < bw; b++) {
+            if (!blocks[y][b])
+                continue;
+            int b2 = b;
+            while (b2 + 1 < bw && blocks[y][b2 + 1])
+                b2++;
+            n += plan_span(y, b*BLOCK_SIZE, min(w, (b2 + 1)*BLOCK_SIZE));
+            b = b2;
+        }
+    }
+    debuglog("plan_refresh %d\n", n);
+}
+
+int bridge_item(int x, int y, int fac, MAP* sq) {
+    int items = sq->built_items;
+    if (!(items & (TERRA_BASE_IN_TILE | TERRA_FUNGUS)) && items & TERRA_ROAD
+    && has_terra(fac, FORMER_RAISE_LAND)) {
+        bool bridge = can_bridge(x, y);
+        int cost = (bridge ? tx_terraform_cost(x, y, fac) : 0);
+        if (bridge && cost < tx_factions[fac].energy_credits/10) {
+            debuglog("bridge_cost %d %d %d %d\n", x, y, fac, cost);
+            tx_factions[fac].energy_credits -= cost;
+            region_watch(x, y);
+            return FORMER_RAISE_LAND;
+        }
+    }
+    return -1;
+}
+
+int tile_score(int turns, int x, int y, MAP* sq) {
     const int priority[][2] = {
         {TERRA_RIVER, 2},
         {TERRA_RIVER_SRC, 2},
@@ -258,15 +852,14 @@ int tile_score(int x1, int y1, int x2, int y2, MAP* sq) {
         {TERRA_SOIL_ENR, -4},
         {TERRA_THERMAL_BORE, -8},
     };
-    int bonus = tx_bonus_at(x2, y2);
-    int range = map_range(x1, y1, x2, y2);
+    int bonus = bonus_at(x, y);
     int items = sq->built_items;
     int score = (sq->landmarks ? 3 : 0);
 
     if (bonus && !(items & IMP_ADVANCED)) {
         bool bh = (bonus == RES_MINERAL || bonus == RES_ENERGY)
-            && has_terra(*tx_active_faction, FORMER_THERMAL_BORE)
-            && can_borehole(x2, y2, bonus);
+            && has_terra(sq->owner, FORMER_THERMAL_BORE)
+            && can_borehole(x, y, bonus);
         int w = (bh || !(items & IMP_SIMPLE) ? 5 : 1);
         score += w * (bonus == RES_NUTRIENT ? 3 : 2);
     }
@@ -275,7 +868,188 @@ int tile_score(int x1, int y1, int x2, int y2, MAP* sq) {
             score += p[1];
         }
     }
-    return score - range + min(8, pm_former[x2][y2]) + pm_safety[x2][y2];
+    return score - turns + min(8, pm_former.get(x, y)) + pm_safety.get(x, y);
+}
+
+int terraform_turns(VEH* veh, int act) {
+    int done = (veh->move_status == act+4 ? veh->terraforming_turns : 0);
+    return max(1, tx_terraform[act].rate - done);
+}
+
+void former_claim(int id, int x, int y, int act, int turns) {
+    VEH* veh = &tx_vehicles[id];
+    int eta = *tx_current_turn + turns + (act >= 0 ? terraform_turns(veh, act) : 0);
+    former_claims[id] = {*tx_current_turn, eta, (short)x, (short)y, veh->faction_id, (short)act};
+    claim_map.set(x, y, id+1);
+}
+
+bool former_reserved(int x, int y, int id) {
+    int v = claim_map.get(x, y) - 1;
+    if (v < 0 || v == id)
+        return false;
+    FormerClaim* c = &former_claims[v];
+    VEH* veh = &tx_vehicles[v];
+    bool live = v < *tx_total_num_vehicles && c->x == x && c->y == y
+        && veh->faction_id == c->fac
+        && tx_units[veh->proto_id].weapon_mode == WMODE_TERRAFORMER
+        && (c->turn == *tx_current_turn
+        || (veh->x_coord == x && veh->y_coord == y
+        && veh->move_status >= 4 && veh->move_status < 24)
+        || (veh->move_status == STATUS_ROAD_TO
+        && veh->waypoint_1_x_coord == x && veh->waypoint_1_y_coord == y));
+    if (live && c->eta + 2 >= *tx_current_turn)
+        return true;
+    debuglog("former_release %d %d %d %d\n", x, y, v, c->act);
+    claim_map.set(x, y, 0);
+    return false;
+}
+
+bool former_target(int id, int fac, int x, int y, MAP* sq) {
+    return sq->owner == fac && !(sq->built_items & TERRA_BASE_IN_TILE)
+        && pm_safety.get(x, y) >= PM_SAFE
+        && pm_former.get(x, y) >= 1
+        && !other_in_tile(fac, sq)
+        && !former_reserved(x, y, id);
+}
+
+int plan_trim(int edge, int ne, int* cut) {
+    if (ne - edge <= PLAN_UNIT_EDGES)
+        return ne;
+    std::nth_element(plan_es + edge, plan_es + edge + PLAN_UNIT_EDGES - 1, plan_es + ne,
+        [](const PlanEdge& a, const PlanEdge& b) { return a.value > b.value; });
+    *cut += ne - edge - PLAN_UNIT_EDGES;
+    return edge + PLAN_UNIT_EDGES;
+}
+
+/* Prices rise by the difference to the second best choice plus one. */
+int plan_auction(int nu, int low) {
+    int queue[VEHICLES];
+    int head = 0;
+    int tail = 0;
+    int items = 0;
+    int bids = 0;
+    for (int i=0; i<nu; i++) {
+        queue[tail++] = i;
+        items++;
+    }
+    tail %= VEHICLES;
+    while (items > 0) {
+        PlanUnit* u = &plan_us[queue[head]];
+        int cur = queue[head];
+        head = (head + 1) % VEHICLES;
+        items--;
+        int best = -1;
+        int v1 = low - 1;
+        int v2 = low - 1;
+        for (int k=u->edge; k < u->edge + u->edges; k++) {
+            int v = plan_es[k].value - plan_js[plan_es[k].job].price;
+            if (v > v1) {
+                v2 = v1;
+                v1 = v;
+                best = plan_es[k].job;
+            } else if (v > v2) {
+                v2 = v;
+            }
+        }
+        if (best < 0 || v1 < low)
+            continue;
+        PlanJob* j = &plan_js[best];
+        j->price += v1 - v2 + 1;
+        if (j->owner >= 0) {
+            plan_us[j->owner].job = -1;
+            queue[tail] = j->owner;
+            tail = (tail + 1) % VEHICLES;
+            items++;
+        }
+        j->owner = cur;
+        u->job = best;
+        bids++;
+    }
+    debuglog("plan_auction %d %d\n", nu, bids);
+    return bids;
+}
+
+void plan_formers(int fac) {
+    int nf = 0;
+    int nj = 0;
+    int ne = 0;
+    int cut = 0;
+    int cutoffs = 0;
+    int low = INT_MAX;
+    static TileSearch ts;
+    former_turns[fac] = *tx_current_turn;
+    plan_terra(fac);
+
+    for (int i=0; i<*tx_total_num_vehicles && nf < VEHICLES; i++) {
+        VEH* veh = &tx_vehicles[i];
+        MAP* sq = mapsq(veh->x_coord, veh->y_coord);
+        if (veh->faction_id != fac || tx_units[veh->proto_id].weapon_mode != WMODE_TERRAFORMER
+        || unit_triad(veh->proto_id) == TRIAD_SEA || !sq || sq->owner != fac)
+            continue;
+        UnitOrder* o = &unit_orders[i];
+        *o = {*tx_current_turn, veh->proto_id, veh->home_base_id,
+            (short)veh->x_coord, (short)veh->y_coord, -1, -1, 0, -1};
+        if (pm_safety.get(veh->x_coord, veh->y_coord) >= PM_SAFE) {
+            if (veh->move_status >= 4 && veh->move_status < 24) {
+                former_claim(i, veh->x_coord, veh->y_coord, veh->move_status - 4, 0);
+                continue;
+            }
+            int item = plan_item(veh->x_coord, veh->y_coord, fac, sq);
+            if (item >= 0) {
+                o->act = item;
+                former_claim(i, veh->x_coord, veh->y_coord, item, 0);
+                if (item == FORMER_THERMAL_BORE)
+                    tile_flags.set(PF_BOREHOLE, veh->x_coord, veh->y_coord);
+                continue;
+            }
+        }
+        PlanUnit* f = &plan_us[nf++];
+        f->id = i;
+        f->edge = ne;
+        f->job = -1;
+        ts.init_moves(veh->x_coord, veh->y_coord, LAND_ONLY, unit_speed(veh->proto_id), 40);
+
+        while ((sq = ts.get_next()) != NULL) {
+            if (!former_target(i, fac, ts.cur_x, ts.cur_y, sq))
+                continue;
+            int j = job_map.get(ts.cur_x, ts.cur_y) - 1;
+            if (j < 0) {
+                if (nj >= PLAN_JOBS)
+                    continue;
+                j = nj++;
+                plan_js[j] = {ts.cur_x, ts.cur_y, tile_score(0, ts.cur_x, ts.cur_y, sq), 0, -1, 0};
+                job_map.set(ts.cur_x, ts.cur_y, j + 1);
+            }
+            int v = plan_js[j].value - ts.turns();
+            plan_es[ne++] = {j, v, ts.turns()};
+            low = min(low, v);
+            if (ne - f->edge >= 2*PLAN_UNIT_EDGES)
+                ne = plan_trim(f->edge, ne, &cut);
+        }
+        ne = plan_trim(f->edge, ne, &cut);
+        cutoffs += ts.cutoffs;
+        f->edges = ne - f->edge;
+    }
+    plan_auction(nf, low);
+    for (int i=0; i<nf; i++) {
+        PlanUnit* f = &plan_us[i];
+        UnitOrder* o = &unit_orders[f->id];
+        if (f->job >= 0) {
+            PlanJob* j = &plan_js[f->job];
+            int turns = 0;
+            for (int k=f->edge; k < f->edge + f->edges; k++) {
+                if (plan_es[k].job == f->job)
+                    turns = plan_es[k].turns;
+            }
+            o->tx = j->x;
+            o->ty = j->y;
+            former_claim(f->id, j->x, j->y, plan_item(j->x, j->y, fac, mapsq(j->x, j->y)), turns);
+        }
+    }
+    for (int i=0; i<nj; i++) {
+        job_map.set(plan_js[i].x, plan_js[i].y, 0);
+    }
+    debuglog("plan_formers %d %d %d %d %d %d\n", fac, nf, nj, ne, cut, cutoffs);
 }
 
 int former_move(int id) {
@@ -287,44 +1061,171 @@ int former_move(int id) {
     if (!sq || sq->owner != fac) {
         return tx_enemy_move(id);
     }
-    if (pm_safety[x][y] >= PM_SAFE) {
+    if (former_turns[fac] != *tx_current_turn && ~*tx_human_players & (1 << fac)) {
+        plan_formers(fac);
+    }
+    UnitOrder* o = &unit_orders[id];
+    bool planned = order_valid(o, veh) && o->x == x && o->y == y;
+    if (pm_safety.get(x, y) >= PM_SAFE) {
         if (veh->move_status >= 4 && veh->move_status < 24) {
             return SYNC;
         }
-        int item = select_item(x, y, fac, sq);
+        int item = bridge_item(x, y, fac, sq);
+        if (item < 0) {
+            item = (planned ? o->act : plan_item(x, y, fac, sq));
+        }
         if (item >= 0) {
-            pm_former[x][y] -= 2;
+            former_claim(id, x, y, item, 0);
+            o->turn = -1;
             debuglog("former_action %d %d %d %d %d\n", x, y, fac, id, item);
             return set_action(id, item+4, *tx_terraform[item].shortcuts);
         }
     }
-    int i = 0;
+    if (planned && o->act < 0 && o->tx >= 0) {
+        o->turn = -1;
+        sq = mapsq(o->tx, o->ty);
+        if (sq && sq->owner == fac && pm_safety.get(o->tx, o->ty) >= PM_SAFE
+        && !other_in_tile(fac, sq) && !former_reserved(o->tx, o->ty, id)) {
+            debuglog("former_order %d %d -> %d %d %d %d\n", x, y, o->tx, o->ty, fac, id);
+            return set_road_to(id, o->tx, o->ty);
+        }
+    }
     int tscore = INT_MIN;
+    int tturns = 0;
     int tx = -1;
     int ty = -1;
-    TileSearch ts;
-    ts.init(x, y, LAND_ONLY);
+    static TileSearch ts;
+    ts.init_moves(x, y, LAND_ONLY, unit_speed(veh->proto_id), 40);
 
-    while (i++ < 40 && (sq = ts.get_next()) != NULL) {
-        if (sq->owner != fac || sq->built_items & TERRA_BASE_IN_TILE
-        || pm_safety[ts.cur_x][ts.cur_y] < PM_SAFE
-        || pm_former[ts.cur_x][ts.cur_y] < 1
-        || other_in_tile(fac, sq))
+    while ((sq = ts.get_next()) != NULL) {
+        if (!former_target(id, fac, ts.cur_x, ts.cur_y, sq))
             continue;
-        int score = tile_score(x, y, ts.cur_x, ts.cur_y, sq);
+        int score = tile_score(ts.turns(), ts.cur_x, ts.cur_y, sq);
         if (score > tscore) {
             tx = ts.cur_x;
             ty = ts.cur_y;
             tscore = score;
+            tturns = ts.turns();
         }
     }
     if (tx >= 0) {
-        pm_former[tx][ty] -= 2;
-        debuglog("former_move %d %d -> %d %d %d %d %d\n", x, y, tx, ty, fac, id, tscore);
+        former_claim(id, tx, ty, plan_item(tx, ty, fac, mapsq(tx, ty)), tturns);
+        debuglog("former_move %d %d -> %d %d %d %d %d %d\n", x, y, tx, ty, fac, id, tscore, ts.cutoffs);
         return set_road_to(id, tx, ty);
     }
     return tx_veh_skip(id);
 }
 
+int convoy_amount(int res, MAP* sq) {
+    return (res == RES_MINERAL && sq->built_items & TERRA_FOREST ? 1 : 2);
+}
+
+int convoy_weight(BASE* base, int res) {
+    bool prefer_min = base->nutrient_surplus > 4 + base->pop_size/2;
+    if (res == RES_NUTRIENT)
+        return (prefer_min ? 0 : 3);
+    return (prefer_min ? 3 : 1);
+}
 
+void plan_crawlers(int fac) {
+    const int stay = 2;
+    int nu = 0;
+    int nj = 0;
+    int ne = 0;
+    int cut = 0;
+    int low = INT_MAX;
 
+    for (int y=0; y < *tx_map_axis_y; y++) {
+        for (int x=y&1; x < *tx_map_axis_x && nj < PLAN_JOBS; x+=2) {
+            MAP* sq = mapsq(x, y);
+            if (sq->owner != fac || sq->altitude < ALTITUDE_MIN_LAND
+            || pm_safety.get(x, y) < PM_SAFE || other_in_tile(fac, sq))
+                continue;
+            int res = want_convoy(fac, x, y, sq);
+            if (res) {
+                plan_js[nj++] = {x, y, convoy_amount(res, sq), 0, -1, res};
+            }
+        }
+    }
+    for (int i=0; i<*tx_total_num_vehicles && nu < VEHICLES; i++) {
+        VEH* veh = &tx_vehicles[i];
+        if (veh->faction_id != fac || veh->home_base_id < 0
+        || tx_units[veh->proto_id].weapon_mode != WMODE_CONVOY
+        || unit_triad(veh->proto_id) != TRIAD_LAND
+        || !mapsq(veh->x_coord, veh->y_coord))
+            continue;
+        BASE* base = &tx_bases[veh->home_base_id];
+        PlanUnit* u = &plan_us[nu++];
+        int region = region_id(veh->x_coord, veh->y_coord);
+        int speed = max(1, unit_speed(veh->proto_id));
+        int kx = veh->x_coord;
+        int ky = veh->y_coord;
+        if (veh->move_status == STATUS_GOTO) {
+            kx = veh->waypoint_1_x_coord;
+            ky = veh->waypoint_1_y_coord;
+        } else if (veh->move_status != STATUS_CONVOY) {
+            kx = -1;
+        }
+        u->id = i;
+        u->edge = ne;
+        u->job = -1;
+        for (int j=0; j<nj; j++) {
+            PlanJob* job = &plan_js[j];
+            int w = convoy_weight(base, job->res);
+            int range = map_range(veh->x_coord, veh->y_coord, job->x, job->y);
+            if (!w || range > CONVOY_RANGE || region_id(job->x, job->y) != region)
+                continue;
+            int turns = (range + speed - 1) / speed;
+            int v = 4 * w * job->value - turns + (job->x == kx && job->y == ky ? stay : 0);
+            plan_es[ne++] = {j, v, turns};
+            low = min(low, v);
+            if (ne - u->edge >= 2*PLAN_UNIT_EDGES)
+                ne = plan_trim(u->edge, ne, &cut);
+        }
+        ne = plan_trim(u->edge, ne, &cut);
+        u->edges = ne - u->edge;
+    }
+    plan_auction(nu, low);
+
+    for (int i=0; i<nu; i++) {
+        PlanUnit* u = &plan_us[i];
+        VEH* veh = &tx_vehicles[u->id];
+        UnitOrder* o = &unit_orders[u->id];
+        o->turn = *tx_current_turn;
+        o->unit = veh->proto_id;
+        o->home = veh->home_base_id;
+        o->x = veh->x_coord;
+        o->y = veh->y_coord;
+        o->tx = -1;
+        o->ty = -1;
+        o->res = 0;
+        if (u->job < 0)
+            continue;
+        PlanJob* j = &plan_js[u->job];
+        o->tx = j->x;
+        o->ty = j->y;
+        o->res = j->res;
+        tile_flags.set(PF_CONVOY, j->x, j->y);
+        bool busy = veh->move_status == STATUS_CONVOY || veh->move_status == STATUS_GOTO;
+        bool keep = (veh->move_status == STATUS_CONVOY && j->x == veh->x_coord && j->y == veh->y_coord)
+            || (veh->move_status == STATUS_GOTO && j->x == veh->waypoint_1_x_coord
+            && j->y == veh->waypoint_1_y_coord);
+        if (busy && !keep) {
+            debuglog("crawler_switch %d %d %d -> %d %d\n", u->id, veh->x_coord, veh->y_coord, j->x, j->y);
+            set_move_to(u->id, j->x, j->y);
+        }
+    }
+    for (int i=0; i<nu; i++) {
+        VEH* veh = &tx_vehicles[plan_us[i].id];
+        if (plan_us[i].job >= 0 || veh->move_status != STATUS_CONVOY)
+            continue;
+        tile_flags.set(PF_CONVOY, veh->x_coord, veh->y_coord);
+        for (int j=0; j<nj; j++) {
+            PlanJob* job = &plan_js[j];
+            if (job->owner >= 0 && job->x == veh->x_coord && job->y == veh->y_coord) {
+                unit_orders[plan_us[job->owner].id].tx = -1;
+            }
+        }
+    }
+    debuglog("plan_crawlers %d %d %d %d %d\n", fac, nu, nj, ne, cut);
+}
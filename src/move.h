@@ -3,6 +3,7 @@
 
 #include "main.h"
 #include "game.h"
+#include "map.h"
 
 #define BASE_DISALLOWED (TERRA_BASE_IN_TILE | TERRA_MONOLITH | TERRA_FUNGUS | TERRA_THERMAL_BORE)
 
@@ -10,8 +11,23 @@
 #define IMP_ADVANCED (TERRA_CONDENSER | TERRA_THERMAL_BORE)
 
 #define PM_SAFE -20
+#define PLAN_JOBS 4096
+#define PLAN_UNIT_EDGES 32
+#define PLAN_EDGES ((VEHICLES + 2) * PLAN_UNIT_EDGES)
+#define CONVOY_RANGE 12
+#define SITE_BLOCKED -1000
+#define PLAN_BORE 0x20
+#define PLAN_VALID 0x80000000
 
 void move_upkeep();
+#ifdef BUILD_DEBUG
+void stamp_bench();
+#endif
+void safety_update();
+void plan_formers(int fac);
+void plan_crawlers(int fac);
+void plan_sites();
+void plan_refresh();
 int crawler_move(int id);
 int colony_move(int id);
 int former_move(int id);